@@ -0,0 +1,30 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator for data living until the end of the run, such as the
+ * program paths. Memory comes in large chunks that never move, so the
+ * returned pointers stay valid, and is only released all at once.
+ */
+
+#define ARENA_CHUNK_SZ	(64 * 1024)
+
+struct arena_chunk;
+
+struct arena_t {
+	struct arena_chunk * head;	/* chunk being filled */
+	size_t used;			/* bytes used in [head] */
+	size_t size;			/* bytes of [head] */
+};
+
+void arena_init(struct arena_t * arena);
+void arena_destroy(struct arena_t * arena);
+
+/* [size] bytes aligned for any type */
+void * arena_alloc(struct arena_t * arena, size_t size);
+
+char * arena_strdup(struct arena_t * arena, const char * str);
+
+#endif
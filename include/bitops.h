@@ -1,3 +1,6 @@
+#ifndef BITOPS_H
+#define BITOPS_H
+
 #ifdef CONFIG_64BIT
 #define BITS_PER_LONG 64
 #else
@@ -35,3 +38,34 @@
 #define NBITS(n) (n==0?0:NBITS32(n))
 
 #define EXTRACT_NBITS(nr, h, l) ((nr&GENMASK(h,l)) >> l)
+
+/*
+ * Word-granular bitmap helpers. A bitmap is an array of unsigned long,
+ * sized with BITS_TO_LONGS(nbits); every word holds BITS_PER_ULONG bits.
+ */
+#define BITS_PER_ULONG          (BITS_PER_BYTE * sizeof(unsigned long))
+#define BITMAP_WORD(nr)         ((nr) / BITS_PER_ULONG)
+#define BITMAP_MASK(nr)         (1UL << ((nr) % BITS_PER_ULONG))
+
+static inline void bitmap_set_bit(unsigned long *map, int nr)
+{
+	map[BITMAP_WORD(nr)] |= BITMAP_MASK(nr);
+}
+
+static inline void bitmap_clear_bit(unsigned long *map, int nr)
+{
+	map[BITMAP_WORD(nr)] &= ~BITMAP_MASK(nr);
+}
+
+static inline int bitmap_test_bit(const unsigned long *map, int nr)
+{
+	return (map[BITMAP_WORD(nr)] & BITMAP_MASK(nr)) != 0;
+}
+
+/* Index of the lowest set bit of a non-zero word */
+static inline int __ffs_ulong(unsigned long word)
+{
+	return __builtin_ctzl(word);
+}
+
+#endif /* BITOPS_H */
@@ -14,6 +14,8 @@
 #include "os-mm.h"
 #endif
 
+#include "rbtree.h"
+
 #define ADDRESS_SIZE 20
 #define OFFSET_LEN 10
 #define FIRST_LV_LEN 5
@@ -48,6 +50,8 @@ struct code_seg_t
 {
 	struct inst_t *text;
 	uint32_t size;
+	int refcount; // Processes and program cache sharing it, see loader.h
+	size_t map_size; // Mapping of a binary program text sits in, or 0
 };
 
 struct trans_table_t
@@ -73,23 +77,42 @@ struct page_table_t
 	int size; // Number of row in the first layer
 };
 
+/* Scheduling timeline of a process, in ticks */
+struct proc_stats
+{
+	uint64_t arrival;	// Admitted by the loader
+	uint64_t first_run;	// First dispatched
+	uint64_t completion;	// Finished
+	uint64_t last_event;	// Last queued or dispatched
+	uint64_t wait;		// Total time spent in ready queues
+	uint64_t run;		// Total time spent on a CPU
+	uint32_t nr_switches;	// Number of dispatches
+};
+
 /* PCB, describe information about a process */
 struct pcb_t
 {
 	uint32_t pid;		 // PID
 	uint32_t priority;	 // Default priority, this legacy process based (FIXED)
-	char path[100];
+	const char *path;	 // Program path, kept by the loader, see loader.h
 	struct code_seg_t *code; // Code segment
 	addr_t regs[10];	 // Registers, store address of allocated regions
 	uint32_t pc;		 // Program pointer, point to the next instruction
 	struct queue_t *ready_queue;
 	struct queue_t *running_list;
+	struct queue_t *queue;	 // Queue currently linking this PCB
+	struct pcb_t *q_prev;	 // Links inside [queue]
+	struct pcb_t *q_next;
 #ifdef MLQ_SCHED
-	struct queue_t *mlq_ready_queue;
 	// Priority on execution (if supported), on-fly aka. changeable
 	// and this vale overwrites the default priority when it existed
 	uint32_t prio;
 #endif
+	uint32_t sched_level;	 // MLFQ level
+	uint64_t sched_gen;	 // MLFQ boost period of [sched_level]
+	uint64_t vruntime;	 // CFS weighted run time
+	struct rb_node sched_node; // CFS timeline link
+	struct proc_stats stats;
 #ifdef MM_PAGING
 	struct mm_struct *mm;
 	struct memphy_struct *mram;
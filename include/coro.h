@@ -0,0 +1,34 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include "timer.h"
+
+/*
+ * M:N simulated CPUs: user-level coroutines multiplexed over a pool of
+ * host threads. Each worker thread is one device of the tick barrier
+ * and resumes its coroutines in turn every slot. A coroutine gets a
+ * virtual device of its own, on which next_slot() and friends do not
+ * enter the barrier but yield back to the worker until the slot the
+ * coroutine asked for.
+ */
+
+struct coro_pool_t;
+
+/* Attach the [nr_workers] worker devices, before start_timer() */
+struct coro_pool_t * coro_pool_create(int nr_workers);
+
+/* Add a coroutine running [fn]([arg]) on the next worker in turn.
+ * Return its device, which [fn] should use for the timer calls */
+struct timer_id_t * coro_spawn(struct coro_pool_t * pool,
+		void * (*fn)(void *), void * arg);
+
+/* Run the workers, return once every coroutine returned */
+void coro_pool_run(struct coro_pool_t * pool);
+
+void coro_pool_destroy(struct coro_pool_t * pool);
+
+/* Yield points behind the timer calls on a coroutine device */
+void coro_next_slots(struct timer_id_t * timer_id, uint64_t nr_slots);
+void coro_next_slot_until(struct timer_id_t * timer_id, uint64_t slot);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef DES_H
+#define DES_H
+
+#include <stdint.h>
+
+/*
+ * Event queue of the discrete-event engine: a binary min-heap ordered by
+ * time slot, then event type, then device id, so that events of one slot
+ * always fire in the same order and a run is deterministic.
+ */
+
+enum des_type {
+	DES_CPU,	/* a CPU simulates one time slot */
+	DES_LOAD,	/* loader admits the processes due */
+};
+
+struct des_event {
+	uint64_t time;
+	enum des_type type;
+	int id;
+};
+
+struct des_queue {
+	struct des_event * heap;
+	int size;
+	int cap;
+};
+
+void des_init(struct des_queue * q, int cap);
+void des_destroy(struct des_queue * q);
+
+void des_push(struct des_queue * q, uint64_t time, enum des_type type, int id);
+
+/* Remove the earliest event into [ev]. Return -1 if [q] is empty */
+int des_pop(struct des_queue * q, struct des_event * ev);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef LDPOOL_H
+#define LDPOOL_H
+
+#include "common.h"
+
+/*
+ * Parser pool of the loader. A few threads read the config entries as a
+ * stream and load their processes ahead of the arrival, in config order
+ * and at most LDPOOL_AHEAD entries ahead of the admissions, so the
+ * clocked loader only hands ready PCBs to the scheduler. Entries live in
+ * a ring of LDPOOL_AHEAD slots, whatever the length of the config.
+ */
+
+#define LDPOOL_AHEAD	256
+
+/* One process of the config */
+struct ld_entry {
+	unsigned long start_time;
+	unsigned long prio;
+	char * path;		/* owned by the slot, reused */
+	size_t path_cap;
+	struct pcb_t * proc;	/* loaded process */
+	int ready;
+};
+
+/* Start [nr_threads] parsers. [read_fn] fills the next entry of the
+ * config and returns 0, or -1 at its end; it is called by one parser at
+ * a time. [load_fn] loads the process of an entry */
+void ldpool_start(int nr_threads, int (*read_fn)(struct ld_entry * e),
+		struct pcb_t * (*load_fn)(struct ld_entry * e));
+
+/* Wait for the next entry to be loaded, NULL once the config is over */
+struct ld_entry * ldpool_peek(void);
+
+/* Done with the entry of ldpool_peek(), its slot can be reused */
+void ldpool_take(void);
+
+/* Join the parser threads, once every entry was taken */
+void ldpool_stop(void);
+
+#endif
@@ -3,7 +3,44 @@
 
 #include "common.h"
 
+/* Create a process running the program at [path]. Programs are parsed
+ * once: processes of the same path share one read-only code segment.
+ * Processes may be loaded ahead and in any order, so the PID is only
+ * given by assign_pid() */
 struct pcb_t * load(const char * path);
 
+/* Give [proc] the next PID, once it is admitted */
+void assign_pid(struct pcb_t * proc);
+
+/*
+ * Binary programs: a prog_header then the packed inst_t array, in host
+ * byte order. load() maps them and runs the instructions in place; a
+ * file without the magic is parsed as a text program.
+ */
+#define PROG_MAGIC	0x4250534fu	/* "OSPB" */
+#define PROG_VERSION	1
+
+struct prog_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t priority;
+	uint32_t size;	/* number of instructions */
+};
+
+/* Read the program at [path], text or binary, into a new code segment
+ * holding one reference. [priority] gets its default priority */
+struct code_seg_t * load_code(const char * path, uint32_t * priority);
+
+/* Write [code] as a binary program at [path]. Return -1 on failure */
+int save_code(const char * path, const struct code_seg_t * code,
+		uint32_t priority);
+
+/* Drop the reference of an exiting process to its code segment */
+void put_code(struct code_seg_t * code);
+
+/* Forget every cached program and their paths, once no process is
+ * left */
+void loader_destroy(void);
+
 #endif
 
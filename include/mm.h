@@ -122,6 +122,9 @@ int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+void free_mm(struct mm_struct *mm);
+int free_pcb_memph(struct pcb_t *caller);
+unsigned long pg_fault_count(void);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -147,11 +150,22 @@ struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn);
+int MEMPHY_get_freefp_run(struct memphy_struct *mp, int order, int *fpn);
+int MEMPHY_put_freefp_run(struct memphy_struct *mp, int fpn, int order);
 int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
 int MEMPHY_dump(struct memphy_struct * mp);
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg);
 
+/* TLB prototypes */
+int tlb_init(int nr_cpus, int size);
+void tlb_destroy(void);
+void tlb_switch(int cpu, struct pcb_t *proc);
+int tlb_lookup(int asid, int pgn, int *fpn);
+void tlb_fill(int asid, int pgn, int fpn);
+void tlb_invalidate_pte(uint32_t *pte);
+void tlb_stats(unsigned long *hits, unsigned long *misses);
+
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
 int print_list_rg(struct vm_rg_struct *rg);
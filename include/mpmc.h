@@ -0,0 +1,42 @@
+#ifndef MPMC_H
+#define MPMC_H
+
+#include "common.h"
+
+/*
+ * Bounded lock-free multi-producer/multi-consumer FIFO of PCBs.
+ * Every cell carries a sequence number telling producers and consumers
+ * whose turn it is, so a push or pop is one CAS on the shared position
+ * plus a store to the claimed cell (D. Vyukov's bounded MPMC queue).
+ */
+
+struct mpmc_cell {
+	unsigned long seq;
+	struct pcb_t * proc;
+};
+
+struct mpmc_ring {
+	unsigned long mask;		// Capacity - 1, capacity is a power of 2
+	char pad0[64];
+	unsigned long enq_pos;		// Next cell to fill
+	char pad1[64];
+	unsigned long deq_pos;		// Next cell to drain
+	char pad2[64];
+	struct mpmc_cell cells[];
+};
+
+/* Allocate a ring holding at least [capacity] PCBs */
+struct mpmc_ring * mpmc_create(unsigned long capacity);
+
+void mpmc_destroy(struct mpmc_ring * ring);
+
+/* Return 0 on success, -1 if the ring is full */
+int mpmc_push(struct mpmc_ring * ring, struct pcb_t * proc);
+
+/* Return the oldest PCB, NULL if the ring is empty */
+struct pcb_t * mpmc_pop(struct mpmc_ring * ring);
+
+/* Snapshot emptiness check, may be stale by the time it returns */
+int mpmc_empty(struct mpmc_ring * ring);
+
+#endif
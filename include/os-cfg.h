@@ -11,5 +11,6 @@
 #define MMDBG 1
 #define IODUMP 1
 #define PAGETBL_DUMP 1
+// #define SCHED_STATS 1
 
 #endif
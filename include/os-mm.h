@@ -1,6 +1,7 @@
 #ifndef OSMM_H
 #define OSMM_H
 
+#include <sys/types.h> /* pthread_mutex_t, pthread.h would pull our sched.h */
 
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
@@ -56,6 +57,13 @@ struct mm_struct {
 
    /* list of free page */
    struct pgn_t *fifo_pgn;
+
+   /* Guards the vmas, free lists, symbols, page table and FIFO above;
+    * the frames come from the devices under their own locks */
+   pthread_mutex_t lock;
+
+   /* CPU whose TLB may cache the page table, -1 if none */
+   int tlb_cpu;
 };
 
 /*
@@ -63,12 +71,29 @@ struct mm_struct {
  */
 struct framephy_struct { 
    int fpn;
+   int fpcount; /* contiguous frames from fpn */
    struct framephy_struct *fp_next;
 
    /* Resereed for tracking allocated framed */
    struct mm_struct* owner;
 };
 
+/*
+ * Magazine of free frames, a small stack in front of the bitmap of a
+ * device. Each host thread uses its own, so allocations on different CPUs
+ * do not contend, and it is refilled from or drained to the bitmap
+ * FP_MAG_BATCH frames at a time.
+ */
+#define FP_MAG_SIZE  32
+#define FP_MAG_BATCH (FP_MAG_SIZE / 2)
+#define FP_NR_MAGS   16
+
+struct fp_magazine {
+   pthread_mutex_t lock;
+   int nr;
+   int fpn[FP_MAG_SIZE]; /* the top is the next frame handed out */
+};
+
 struct memphy_struct {
    /* Basic field of data and size */
    BYTE *storage;
@@ -79,9 +104,22 @@ struct memphy_struct {
    int cursor; /* if rdmflg = 0 read/write, otherwise not important */
    /* SWAP need sequential access, RAM need random access*/
 
-   /* Management structure */
-   struct framephy_struct *free_fp_list;
-   struct framephy_struct *used_fp_list;
+   /* Management structure: one bit per frame, set while it is free and
+    * not held by a magazine, under fp_lock */
+   pthread_mutex_t fp_lock;
+   unsigned long *fp_bitmap;
+   int nr_fp;      /* frames of the device */
+   int nr_free_fp; /* frames left in the bitmap */
+   int fp_hint;    /* no free frame in the words before this one */
+   unsigned long *fp_owned; /* one bit per frame handed out, atomic */
+   struct fp_magazine fp_mags[FP_NR_MAGS];
 };
 
+#define FP_WORD_BITS (8 * (int) sizeof(unsigned long))
+
+/* Requests of at least 2^FP_RUN_MIN_ORDER frames take naturally aligned
+ * runs of 2^k contiguous frames from the bitmap, smaller ones go frame by
+ * frame through the magazines */
+#define FP_RUN_MIN_ORDER 3
+
 #endif
@@ -0,0 +1,29 @@
+#ifndef PROCTBL_H
+#define PROCTBL_H
+
+#include "common.h"
+
+/*
+ * Global process table. PIDs are handed out densely by the loader, so the
+ * table is a direct-indexed array PID -> PCB, plus a packed array of the
+ * live PCBs for walks that must visit every process. Where a process sits
+ * (run queue, ready level or running list) is kept in the PCB itself
+ * (pcb_t::queue), so removal does not depend on how many processes
+ * exist.
+ */
+
+void proctbl_init(void);
+void proctbl_destroy(void);
+
+/* Insert [proc] under its PID */
+int proc_register(struct pcb_t * proc);
+
+/* Drop [proc] from the table */
+void proc_unregister(struct pcb_t * proc);
+
+/* Call [fn] on every live process while holding the table. The process
+ * is dropped from the table when [fn] returns non-zero, so [fn] may
+ * release it. Return the number of dropped processes */
+int proctbl_for_each(int (*fn)(struct pcb_t * proc, void * arg), void * arg);
+
+#endif
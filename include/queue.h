@@ -4,10 +4,12 @@
 
 #include "common.h"
 
-#define MAX_QUEUE_SIZE 10
-
+/* Unbounded FIFO of PCBs, linked through the PCBs themselves. A PCB sits
+ * in at most one queue at a time (pcb_t::queue), which gives O(1)
+ * enqueue, dequeue and removal by handle. */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct pcb_t * head;
+	struct pcb_t * tail;
 	int size;
 };
 
@@ -17,7 +19,7 @@ struct pcb_t * dequeue(struct queue_t * q);
 
 void peek_at_id(struct queue_t *q, uint32_t pid);
 
-void peek_at_index(struct queue_t *q, int index);
+void queue_remove(struct queue_t *q, struct pcb_t *proc);
 
 int empty(struct queue_t * q);
 
@@ -0,0 +1,55 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stddef.h>
+
+/*
+ * Intrusive red-black tree. The node is embedded in the object it orders
+ * (see rb_entry), and the caller walks down the tree to find the insert
+ * position itself, so the tree never calls back into a comparator:
+ *
+ *	link = &root->rb_node; parent = NULL;
+ *	while (*link) { parent = *link; link = less ? &left : &right; }
+ *	rb_link_node(node, parent, link);
+ *	rb_insert_color(node, root);
+ */
+
+#define RB_RED		0
+#define RB_BLACK	1
+
+struct rb_node {
+	struct rb_node * rb_parent;
+	struct rb_node * rb_left;
+	struct rb_node * rb_right;
+	int rb_color;
+};
+
+struct rb_root {
+	struct rb_node * rb_node;
+};
+
+#define RB_ROOT		(struct rb_root) { NULL }
+
+#define rb_entry(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+static inline void rb_link_node(struct rb_node * node,
+		struct rb_node * parent, struct rb_node ** link) {
+	node->rb_parent = parent;
+	node->rb_left = node->rb_right = NULL;
+	node->rb_color = RB_RED;
+	*link = node;
+}
+
+/* Rebalance after rb_link_node() */
+void rb_insert_color(struct rb_node * node, struct rb_root * root);
+
+void rb_erase(struct rb_node * node, struct rb_root * root);
+
+/* Smallest node, NULL if the tree is empty */
+struct rb_node * rb_first(const struct rb_root * root);
+
+/* In-order successor, NULL for the last node */
+struct rb_node * rb_next(const struct rb_node * node);
+
+#endif
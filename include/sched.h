@@ -11,18 +11,41 @@
 
 int queue_empty(void);
 
-void init_scheduler(void);
+/* Select the scheduling policy by name: fifo, rr, mlq, mlfq,
+ * sri or cfs.
+ * Must be called before init_scheduler(). Return -1 if unknown */
+int sched_set_policy(const char * name);
+const char * sched_policy(void);
+
+/* Set up one run queue per simulated CPU for a run of at most
+ * [max_procs] processes, [time_slot] being the base quantum */
+void init_scheduler(int num_cpus, int time_slot, int max_procs);
 void finish_scheduler(void);
 
-/* Get the next process from ready queue */
-struct pcb_t * get_proc(void);
+/* Get the next process for [cpu], stealing from the busiest CPU
+ * when its own queue is empty */
+struct pcb_t * get_proc(int cpu);
 
-/* Put a process back to run queue */
-void put_proc(struct pcb_t * proc);
+/* Put a process back to run queue of [cpu] */
+void put_proc(int cpu, struct pcb_t * proc);
 
-/* Add a new process to ready queue */
+/* Add a new process to ready queue of the least loaded CPU */
 void add_proc(struct pcb_t * proc);
 
+/* Drop a finished process from running list of [cpu] */
+void finish_proc(int cpu, struct pcb_t * proc);
+
+/* Number of ticks [proc] may run once dispatched on [cpu] */
+int sched_slice(int cpu, struct pcb_t * proc);
+
+/* Account one tick of [proc] on [cpu]. Non-zero means [proc] must be
+ * preempted now */
+int sched_tick(int cpu, struct pcb_t * proc);
+
+/* Terminate every process accepted by [match]. Return the number of
+ * killed processes */
+int kill_procs(int (*match)(struct pcb_t * proc, void * arg), void * arg);
+
 #endif
 
 
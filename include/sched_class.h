@@ -0,0 +1,55 @@
+#ifndef SCHED_CLASS_H
+#define SCHED_CLASS_H
+
+#include "common.h"
+#include "queue.h"
+#include <pthread.h>
+
+/*
+ * Scheduler internals shared by the dispatch core (sched.c) and the
+ * policies (sched_*.c). Not meant for the rest of the simulator, which
+ * only sees sched.h.
+ */
+
+/* Per-CPU run queue */
+struct runqueue_t {
+	pthread_mutex_t lock;		/* guards running_list */
+	struct queue_t running_list;
+	int nr_ready;			/* procs queued on this CPU */
+	int cpu;
+	void * priv;			/* policy private state */
+};
+
+/*
+ * Scheduling policy. Hooks are called without any run queue lock held;
+ * each policy synchronizes its own private state, since the loader, the
+ * owner CPU and stealing CPUs may all reach the same run queue at once.
+ */
+struct sched_class {
+	const char * name;
+	int (*init)(struct runqueue_t * rq);
+	void (*exit)(struct runqueue_t * rq);
+	/* Queue a newly admitted process */
+	void (*enqueue)(struct runqueue_t * rq, struct pcb_t * proc);
+	/* Queue a process back once its time slice is over */
+	void (*requeue)(struct runqueue_t * rq, struct pcb_t * proc);
+	/* Dequeue the process to run next, NULL if none */
+	struct pcb_t * (*pick_next)(struct runqueue_t * rq);
+	/* Number of ticks [proc] may run once dispatched */
+	int (*time_slice)(struct runqueue_t * rq, struct pcb_t * proc);
+	/* Account one executed tick of [proc], non-zero forces preemption */
+	int (*on_tick)(struct runqueue_t * rq, struct pcb_t * proc);
+};
+
+/* Run parameters, set by init_scheduler() */
+extern int sched_time_slot;
+extern int sched_max_procs;
+
+extern const struct sched_class fifo_sched_class;
+extern const struct sched_class rr_sched_class;
+extern const struct sched_class mlq_sched_class;
+extern const struct sched_class mlfq_sched_class;
+extern const struct sched_class sri_sched_class;
+extern const struct sched_class cfs_sched_class;
+
+#endif
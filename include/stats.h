@@ -0,0 +1,30 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "common.h"
+#include <stdio.h>
+
+/*
+ * Per-process scheduling latency. The scheduler stamps pcb_t::stats as a
+ * process moves between ready queues and CPUs; when it finishes, its
+ * timeline is kept so that the run can be summarized at exit.
+ */
+
+void stats_init(int max_procs);
+void stats_destroy(void);
+
+/* Scheduler hooks, [now] is the current tick */
+void stats_arrive(struct pcb_t * proc, uint64_t now);
+void stats_dispatch(struct pcb_t * proc, uint64_t now);
+void stats_preempt(struct pcb_t * proc, uint64_t now);
+void stats_finish(struct pcb_t * proc, uint64_t now);
+
+/* Number of finished processes, and the tick the last one finished at
+ * in [last] */
+int stats_finished(uint64_t * last);
+
+/* Print p50/p95/p99 of wait, response and turnaround time of every
+ * finished process */
+void stats_report(FILE * out);
+
+#endif
@@ -4,13 +4,19 @@
 #include <pthread.h>
 #include <stdint.h>
 
+struct coro_t;
+
+/* A device taking part in the tick barrier */
 struct timer_id_t {
-	int done;
-	int fsh;
-	pthread_cond_t event_cond;
-	pthread_mutex_t event_lock;
-	pthread_cond_t timer_cond;
-	pthread_mutex_t timer_lock;
+	int fsh;	/* detached, no longer waited for */
+	int away;	/* out of the barrier, see next_slots() */
+	uint64_t wake;	/* first slot back */
+	struct timer_id_t * next_away;
+	pthread_cond_t away_cond;
+	uint64_t clock;	/* local clock, parallel mode only */
+	int nr_clock_waiters;
+	pthread_cond_t clock_cond;
+	struct coro_t * coro;	/* virtual device of a coroutine, see coro.h */
 };
 
 void start_timer();
@@ -23,6 +29,43 @@ void detach_event(struct timer_id_t * event);
 
 void next_slot(struct timer_id_t* timer_id);
 
+/* Done with this slot and the [nr_slots] - 1 following ones: the device
+ * leaves the barrier meanwhile, so the other devices run these slots
+ * without waiting for it. Return once slot now + [nr_slots] started */
+void next_slots(struct timer_id_t* timer_id, uint64_t nr_slots);
+
+/* Nothing to do for this device before time slot [slot], or ever with
+ * TIMER_NO_EVENT. Still waits for the next slot of the run, which only
+ * skips ahead in tickless mode */
+#define TIMER_NO_EVENT UINT64_MAX
+void next_slot_until(struct timer_id_t* timer_id, uint64_t slot);
+
+/* Let the timer fast-forward over slots where every device is idle.
+ * Must be called before start_timer() */
+void set_tickless(int enable);
+
+/*
+ * Conservative parallel mode, run without start_timer(): every device
+ * keeps its own clock, the next slot it will simulate, and only waits
+ * for the others before an event they could observe.
+ */
+
+/* Make current_time() of the calling thread return the clock of
+ * [timer_id] */
+void bind_clock(struct timer_id_t* timer_id);
+
+uint64_t clock_of(struct timer_id_t* timer_id);
+
+/* The device simulated every slot before [slot] */
+void clock_advance(struct timer_id_t* timer_id, uint64_t slot);
+
+/* Wait until every other device simulated every slot before [slot] */
+void clock_sync(struct timer_id_t* timer_id, uint64_t slot);
+
+/* Drive the clock by hand, for the single-threaded engine which runs
+ * without the timer thread */
+void set_time(uint64_t slot);
+
 uint64_t current_time();
 
 #endif
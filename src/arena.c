@@ -0,0 +1,51 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct arena_chunk {
+	struct arena_chunk * next;
+	max_align_t data[];
+};
+
+void arena_init(struct arena_t * arena) {
+	arena->head = NULL;
+	arena->used = arena->size = 0;
+}
+
+void arena_destroy(struct arena_t * arena) {
+	struct arena_chunk * chunk;
+
+	while ((chunk = arena->head) != NULL) {
+		arena->head = chunk->next;
+		free(chunk);
+	}
+	arena->used = arena->size = 0;
+}
+
+void * arena_alloc(struct arena_t * arena, size_t size) {
+	struct arena_chunk * chunk;
+	size_t align = sizeof(max_align_t);
+	void * ptr;
+
+	size = (size + align - 1) & ~(align - 1);
+	if (arena->head == NULL || arena->used + size > arena->size) {
+		/* Oversized requests get a chunk of their own */
+		size_t len = size > ARENA_CHUNK_SZ ? size : ARENA_CHUNK_SZ;
+
+		chunk = malloc(sizeof(struct arena_chunk) + len);
+		chunk->next = arena->head;
+		arena->head = chunk;
+		arena->used = 0;
+		arena->size = len;
+	}
+	ptr = (char *) arena->head->data + arena->used;
+	arena->used += size;
+	return ptr;
+}
+
+char * arena_strdup(struct arena_t * arena, const char * str) {
+	size_t len = strlen(str) + 1;
+
+	return memcpy(arena_alloc(arena, len), str, len);
+}
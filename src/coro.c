@@ -0,0 +1,177 @@
+#include "coro.h"
+
+#include <stdlib.h>
+#include <ucontext.h>
+
+/* Stack of one coroutine. Only touched pages are backed, so a large
+ * pool of simulated CPUs costs little more than the pages in use */
+#define CORO_STACK_SIZE	(256 * 1024)
+
+struct coro_worker;
+
+struct coro_t {
+	ucontext_t ctx;
+	void * stack;
+	void * (*fn)(void *);
+	void * arg;
+	struct timer_id_t dev;	/* handed to [fn] */
+	struct coro_worker * worker;
+	uint64_t wake;		/* first slot to resume it in */
+	uint64_t event;		/* first slot it has work in */
+	int finished;
+	struct coro_t * next;
+};
+
+struct coro_worker {
+	pthread_t thread;
+	struct timer_id_t * timer_id;
+	ucontext_t ctx;		/* where the coroutines yield to */
+	struct coro_t * coros;
+	struct coro_t ** tail;
+};
+
+struct coro_pool_t {
+	struct coro_worker * workers;
+	int nr_workers;
+	int next_worker;	/* gets the next coroutine */
+};
+
+/* Coroutine being resumed by the calling worker */
+static __thread struct coro_t * current;
+
+static void coro_entry(void) {
+	struct coro_t * coro = current;
+
+	coro->fn(coro->arg);
+	coro->finished = 1;
+	/* Back to the worker through uc_link */
+}
+
+struct coro_pool_t * coro_pool_create(int nr_workers) {
+	struct coro_pool_t * pool = malloc(sizeof(struct coro_pool_t));
+	int i;
+
+	pool->nr_workers = nr_workers > 0 ? nr_workers : 1;
+	pool->workers = malloc(pool->nr_workers * sizeof(struct coro_worker));
+	pool->next_worker = 0;
+	for (i = 0; i < pool->nr_workers; i++) {
+		pool->workers[i].timer_id = attach_event();
+		pool->workers[i].coros = NULL;
+		pool->workers[i].tail = &pool->workers[i].coros;
+	}
+	return pool;
+}
+
+struct timer_id_t * coro_spawn(struct coro_pool_t * pool,
+		void * (*fn)(void *), void * arg) {
+	struct coro_worker * worker = &pool->workers[pool->next_worker];
+	struct coro_t * coro = calloc(1, sizeof(struct coro_t));
+
+	pool->next_worker = (pool->next_worker + 1) % pool->nr_workers;
+	coro->stack = malloc(CORO_STACK_SIZE);
+	coro->fn = fn;
+	coro->arg = arg;
+	coro->dev.coro = coro;
+	coro->worker = worker;
+	coro->wake = 0;
+	coro->event = 0;
+
+	getcontext(&coro->ctx);
+	coro->ctx.uc_stack.ss_sp = coro->stack;
+	coro->ctx.uc_stack.ss_size = CORO_STACK_SIZE;
+	coro->ctx.uc_link = &worker->ctx;
+	makecontext(&coro->ctx, coro_entry, 0);
+
+	*worker->tail = coro;
+	worker->tail = &coro->next;
+	return &coro->dev;
+}
+
+static void coro_yield(struct coro_t * coro) {
+	swapcontext(&coro->ctx, &coro->worker->ctx);
+}
+
+void coro_next_slots(struct timer_id_t * timer_id, uint64_t nr_slots) {
+	struct coro_t * coro = timer_id->coro;
+
+	coro->wake = current_time() + (nr_slots > 0 ? nr_slots : 1);
+	coro->event = coro->wake;
+	coro_yield(coro);
+}
+
+void coro_next_slot_until(struct timer_id_t * timer_id, uint64_t slot) {
+	struct coro_t * coro = timer_id->coro;
+
+	/* Resumed in the next slot of the run anyway, like a device of
+	 * the barrier; [slot] only lets the timer skip ahead */
+	coro->wake = current_time() + 1;
+	coro->event = slot;
+	coro_yield(coro);
+}
+
+/*
+ * Every slot, resume the coroutines due in it, then wait for the
+ * earliest slot one of them is due in. When all of them sleep for a few
+ * slots the worker leaves the barrier for as long.
+ */
+static void * worker_routine(void * args) {
+	struct coro_worker * worker = (struct coro_worker *) args;
+	struct coro_t * coro;
+	uint64_t now, wake, event;
+	int nr_live;
+
+	for (;;) {
+		now = current_time();
+		wake = event = TIMER_NO_EVENT;
+		nr_live = 0;
+		for (coro = worker->coros; coro != NULL; coro = coro->next) {
+			if (coro->finished)
+				continue;
+			if (coro->wake <= now) {
+				current = coro;
+				swapcontext(&worker->ctx, &coro->ctx);
+				current = NULL;
+				if (coro->finished)
+					continue;
+			}
+			nr_live++;
+			if (coro->wake < wake)
+				wake = coro->wake;
+			if (coro->event < event)
+				event = coro->event;
+		}
+		if (nr_live == 0)
+			break;
+		if (wake > now + 1)
+			next_slots(worker->timer_id, wake - now);
+		else
+			next_slot_until(worker->timer_id, event);
+	}
+	detach_event(worker->timer_id);
+	return NULL;
+}
+
+void coro_pool_run(struct coro_pool_t * pool) {
+	int i;
+
+	for (i = 0; i < pool->nr_workers; i++)
+		pthread_create(&pool->workers[i].thread, NULL,
+			worker_routine, &pool->workers[i]);
+	for (i = 0; i < pool->nr_workers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+}
+
+void coro_pool_destroy(struct coro_pool_t * pool) {
+	struct coro_t * coro;
+	int i;
+
+	for (i = 0; i < pool->nr_workers; i++) {
+		while ((coro = pool->workers[i].coros) != NULL) {
+			pool->workers[i].coros = coro->next;
+			free(coro->stack);
+			free(coro);
+		}
+	}
+	free(pool->workers);
+	free(pool);
+}
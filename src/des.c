@@ -0,0 +1,63 @@
+#include "des.h"
+
+#include <stdlib.h>
+
+static int des_before(const struct des_event * a, const struct des_event * b) {
+	if (a->time != b->time)
+		return a->time < b->time;
+	if (a->type != b->type)
+		return a->type < b->type;
+	return a->id < b->id;
+}
+
+void des_init(struct des_queue * q, int cap) {
+	q->cap = cap > 0 ? cap : 1;
+	q->heap = malloc(q->cap * sizeof(struct des_event));
+	q->size = 0;
+}
+
+void des_destroy(struct des_queue * q) {
+	free(q->heap);
+	q->heap = NULL;
+	q->size = q->cap = 0;
+}
+
+void des_push(struct des_queue * q, uint64_t time, enum des_type type, int id) {
+	struct des_event ev = { time, type, id };
+	int i, parent;
+
+	if (q->size == q->cap) {
+		q->cap *= 2;
+		q->heap = realloc(q->heap, q->cap * sizeof(struct des_event));
+	}
+	// Sift up from the new leaf
+	for (i = q->size++; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (!des_before(&ev, &q->heap[parent]))
+			break;
+		q->heap[i] = q->heap[parent];
+	}
+	q->heap[i] = ev;
+}
+
+int des_pop(struct des_queue * q, struct des_event * ev) {
+	struct des_event last;
+	int i, child;
+
+	if (q->size == 0)
+		return -1;
+	*ev = q->heap[0];
+	last = q->heap[--q->size];
+	// Sift the last leaf down from the root
+	for (i = 0; (child = 2 * i + 1) < q->size; i = child) {
+		if (child + 1 < q->size &&
+				des_before(&q->heap[child + 1], &q->heap[child]))
+			child++;
+		if (!des_before(&q->heap[child], &last))
+			break;
+		q->heap[i] = q->heap[child];
+	}
+	if (q->size > 0)
+		q->heap[i] = last;
+	return 0;
+}
@@ -0,0 +1,96 @@
+#include "ldpool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+static int (*ld_read)(struct ld_entry * e);
+static struct pcb_t * (*ld_load)(struct ld_entry * e);
+static struct ld_entry ring[LDPOOL_AHEAD];
+static unsigned long nr_read;	/* entries read from the config */
+static unsigned long nr_taken;	/* entries handed to the loader */
+static int config_end;
+
+static pthread_t * parsers;
+static int nr_parsers;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready_cond = PTHREAD_COND_INITIALIZER;	/* loaded */
+static pthread_cond_t room_cond = PTHREAD_COND_INITIALIZER;	/* taken */
+
+static void * parser_routine(void * args) {
+	struct ld_entry * e;
+
+	pthread_mutex_lock(&pool_lock);
+	while (!config_end) {
+		/* Stay within the lookahead window */
+		if (nr_read >= nr_taken + LDPOOL_AHEAD) {
+			pthread_cond_wait(&room_cond, &pool_lock);
+			continue;
+		}
+		e = &ring[nr_read % LDPOOL_AHEAD];
+		if (ld_read(e) < 0) {
+			config_end = 1;
+			pthread_cond_broadcast(&ready_cond);
+			break;
+		}
+		e->ready = 0;
+		nr_read++;
+		pthread_mutex_unlock(&pool_lock);
+
+		e->proc = ld_load(e);
+
+		pthread_mutex_lock(&pool_lock);
+		e->ready = 1;
+		pthread_cond_broadcast(&ready_cond);
+	}
+	pthread_mutex_unlock(&pool_lock);
+	return NULL;
+}
+
+void ldpool_start(int nr_threads, int (*read_fn)(struct ld_entry * e),
+		struct pcb_t * (*load_fn)(struct ld_entry * e)) {
+	int i;
+
+	ld_read = read_fn;
+	ld_load = load_fn;
+	nr_read = nr_taken = 0;
+	config_end = 0;
+	for (i = 0; i < LDPOOL_AHEAD; i++) {
+		ring[i].path = NULL;
+		ring[i].path_cap = 0;
+	}
+
+	nr_parsers = nr_threads > 0 ? nr_threads : 1;
+	parsers = malloc(nr_parsers * sizeof(pthread_t));
+	for (i = 0; i < nr_parsers; i++)
+		pthread_create(&parsers[i], NULL, parser_routine, NULL);
+}
+
+struct ld_entry * ldpool_peek(void) {
+	struct ld_entry * e = &ring[nr_taken % LDPOOL_AHEAD];
+
+	pthread_mutex_lock(&pool_lock);
+	while (nr_taken == nr_read ? !config_end : !e->ready)
+		pthread_cond_wait(&ready_cond, &pool_lock);
+	if (nr_taken == nr_read)
+		e = NULL;
+	pthread_mutex_unlock(&pool_lock);
+	return e;
+}
+
+void ldpool_take(void) {
+	pthread_mutex_lock(&pool_lock);
+	nr_taken++;
+	pthread_cond_broadcast(&room_cond);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+void ldpool_stop(void) {
+	int i;
+
+	for (i = 0; i < nr_parsers; i++)
+		pthread_join(parsers[i], NULL);
+	for (i = 0; i < LDPOOL_AHEAD; i++)
+		free(ring[i].path);
+	free(parsers);
+	parsers = NULL;
+}
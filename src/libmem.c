@@ -22,7 +22,7 @@
 #include <stdio.h>
 #include <pthread.h>
 
-static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long nr_pgfaults; /* pages brought back online */
 
 /*enlist_vm_freerg_list - add new rg to freerg_list
  *@mm: memory region
@@ -38,7 +38,9 @@ int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct *rg_elmt) {
       return -1;
   // If list has dummy head (zero-sized), replace with new region
   else if(curr && curr->rg_start == curr->rg_end){ 
+    rg_elmt->rg_next = curr->rg_next;
     mm->mmap->vm_freerg_list = rg_elmt;
+    free(curr);
     return 0;
   }
   // Traverse list to find insert pos
@@ -114,7 +116,7 @@ int delist_vm_freerg_list(struct mm_struct **mm, struct vm_rg_struct *rg_elmt){
  *
  */
 struct vm_rg_struct *get_symrg_byid(struct mm_struct *mm, int rgid){
-  if (rgid < 0 || rgid > PAGING_MAX_SYMTBL_SZ)
+  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
     return NULL;
 
   return &mm->symrgtbl[rgid];
@@ -129,13 +131,13 @@ struct vm_rg_struct *get_symrg_byid(struct mm_struct *mm, int rgid){
  *
  */
 int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr){
-  pthread_mutex_lock(&mmvm_lock); // sync vm alloc
+  pthread_mutex_lock(&caller->mm->lock); // sync vm alloc
   /*Allocate at the toproof */
   struct vm_rg_struct rgnode;
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
 
   if(cur_vma == NULL){ // invalid VMA
-    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_unlock(&caller->mm->lock);
     return -1;
   }
 
@@ -153,7 +155,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
     print_pgtbl(caller, 0, -1);
 #endif
 #endif
-    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_unlock(&caller->mm->lock);
     return 0; // alloc success
   }
 
@@ -169,7 +171,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
   
   // SYSCALL 17 - ask kernel to grow VMA
   if(syscall(caller, 17, &regs) < 0){
-    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_unlock(&caller->mm->lock);
     return -1; // fail to inc limit
   }
 
@@ -194,7 +196,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
 #endif
 #endif
   
-  pthread_mutex_unlock(&mmvm_lock);
+  pthread_mutex_unlock(&caller->mm->lock);
   return 0;
 
 }
@@ -208,10 +210,17 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
  */
 int __free(struct pcb_t *caller, int vmaid, int rgid){
   
-  if(rgid < 0 || rgid > PAGING_MAX_SYMTBL_SZ)
+  if(rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
     return -1; // invalid region id
 
+  pthread_mutex_lock(&caller->mm->lock);
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+
+  if(cur_vma == NULL){ // invalid VMA
+    pthread_mutex_unlock(&caller->mm->lock);
+    return -1;
+  }
+
   // Fetch region info from symtbl
   struct vm_rg_struct * rgnode = malloc(sizeof(struct vm_rg_struct));
   rgnode->rg_start = cur_vma->vm_mm->symrgtbl[rgid].rg_start;
@@ -233,6 +242,7 @@ int __free(struct pcb_t *caller, int vmaid, int rgid){
   print_pgtbl(caller, 0, -1);
 #endif
 #endif
+  pthread_mutex_unlock(&caller->mm->lock);
 
   return 0;
 }
@@ -269,24 +279,33 @@ int libfree(struct pcb_t *proc, uint32_t reg_index){
  *@framenum: return FPN
  *@caller: caller
  *
+ * The caller holds mm->lock.
  */
 int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller){
+  if (tlb_lookup(caller->pid, pgn, fpn) == 0)
+    return 0;
+
   uint32_t pte = mm->pgd[pgn];
 
   if(pte < 0){ // page not alloc
     return -1;
   }
 
-  if (!PAGING_PAGE_PRESENT(pte)){ /* Page is not online, make it actively living */
-    pthread_mutex_lock(&mmvm_lock);
+  if (!PAGING_PAGE_PRESENT(pte) || (pte & PAGING_PTE_SWAPPED_MASK)){ /* Page is not online, make it actively living */
+    __atomic_fetch_add(&nr_pgfaults, 1, __ATOMIC_RELAXED);
     int vicpgn, swpfpn; 
     int vicfpn;
-    int dsrfpn = PAGING_PTE_FPN(pte); // find pgn in backing store
+    int swapped = pte & PAGING_PTE_SWAPPED_MASK;
+    int dsrfpn = swapped ? PAGING_PTE_SWP(pte) : PAGING_PTE_FPN(pte); // find pgn in backing store
     uint32_t vicpte;
 
     // Pick victim + find free swpfpn
-    if(MEMPHY_get_freefp(caller->active_mswp, &swpfpn) < 0 || find_victim_page(caller->mm, &vicpgn) < 0)
+    if(MEMPHY_get_freefp(caller->active_mswp, &swpfpn) < 0)
+      return -1;
+    if(find_victim_page(caller->mm, &vicpgn) < 0){
+      MEMPHY_put_freefp(caller->active_mswp, swpfpn);
       return -1;
+    }
     
     // Victim info
     vicpte = mm->pgd[vicpgn];
@@ -298,12 +317,18 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller){
     regs.a3 = (uint32_t) swpfpn;
 
     // Swap out: RAM -> SWAP
-    if(syscall(caller, 17, &regs) < 0)
+    if(syscall(caller, 17, &regs) < 0){
+      MEMPHY_put_freefp(caller->active_mswp, swpfpn);
       return -1;
+    }
 
     // Swap in: SWAP -> RAM
-    if(__swap_cp_page(caller->active_mswp, dsrfpn, caller->mram, vicfpn) < 0)
+    if(__swap_cp_page(caller->active_mswp, dsrfpn, caller->mram, vicfpn) < 0){
+      MEMPHY_put_freefp(caller->active_mswp, swpfpn);
       return -1;
+    }
+    if(swapped)
+      MEMPHY_put_freefp(caller->active_mswp, dsrfpn);
 
     // Mark victim as swapped
     pte_set_swap(&mm->pgd[vicpgn], 0, swpfpn);
@@ -313,9 +338,9 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller){
 
     // FIFO: add new pgn to FIFO queue
     enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
-    pthread_mutex_unlock(&mmvm_lock);
   }
   *fpn = PAGING_FPN(mm->pgd[pgn]);
+  tlb_fill(caller->pid, pgn, *fpn);
 
   return 0;
 }
@@ -332,9 +357,12 @@ int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller){
   int off = PAGING_OFFST(addr);                 // Offset
   int fpn;                                      // Frame num
 
+  pthread_mutex_lock(&mm->lock);
   // Ensure page present, swap in if needed
-  if (pg_getpage(mm, pgn, &fpn, caller) < 0)
+  if (pg_getpage(mm, pgn, &fpn, caller) < 0){
+    pthread_mutex_unlock(&mm->lock);
     return -1; /* invalid page access */
+  }
 
   // Calc phys addr = frame base + offset
   int phyaddr = fpn * PAGING_PAGESZ + off;
@@ -346,8 +374,10 @@ int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller){
   regs.a2 = (uint32_t) phyaddr;
   // regs.a3 = (uint32_t) data;
 
-  // SYSCALL 17: write byte at phys addr
-  if(syscall(caller, 17, &regs) < 0)
+  // SYSCALL 17: write byte at phys addr, the page stays mapped meanwhile
+  int ret = syscall(caller, 17, &regs);
+  pthread_mutex_unlock(&mm->lock);
+  if(ret < 0)
     return -1;
 
   // Update data
@@ -366,7 +396,9 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller){
   int pgn = PAGING_PGN(addr);               
   int off = PAGING_OFFST(addr);     
   int fpn;                               
+  pthread_mutex_lock(&mm->lock);
   if (pg_getpage(mm, pgn, &fpn, caller) < 0){
+    pthread_mutex_unlock(&mm->lock);
     return -1;
   }
 
@@ -378,8 +410,10 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller){
   regs.a2 = (uint32_t) phyaddr;
   regs.a3 = (uint32_t) value;
 
-  // SYSCALL 17: write byte at phys addr
-  if(syscall(caller, 17, &regs) < 0)
+  // SYSCALL 17: write byte at phys addr, the page stays mapped meanwhile
+  int ret = syscall(caller, 17, &regs);
+  pthread_mutex_unlock(&mm->lock);
+  if(ret < 0)
     return -1;
 
   // Output read value
@@ -414,7 +448,7 @@ int libread(
     uint32_t offset,    // Source address = [source] + [offset]
     uint32_t* destination)
 {
-  BYTE data;
+  BYTE data = 0; /* what a failed read yields */
   int val = __read(proc, 0, source, offset, &data);
 
   /* TODO update result of reading action*/
@@ -476,30 +510,43 @@ int libwrite(
   return val;
 }
 
+/*pg_fault_count - number of page faults served so far
+ */
+unsigned long pg_fault_count(void)
+{
+  return __atomic_load_n(&nr_pgfaults, __ATOMIC_RELAXED);
+}
+
 /*free_pcb_memphy - collect all memphy of pcb
  *@caller: caller
- *@vmaid: ID vm area to alloc memory region
- *@incpgnum: number of page
+ *
+ * Give the frames backing the pages of caller back to RAM and swap, once
+ * it exits. Only the pages below the break of each vma can be mapped.
  */
 int free_pcb_memph(struct pcb_t *caller)
 {
-  int pagenum, fpn;
+  struct vm_area_struct *vma;
+  int pagenum, endpgn;
   uint32_t pte;
 
-
-  for(pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
+  pthread_mutex_lock(&caller->mm->lock);
+  for(vma = caller->mm->mmap; vma != NULL; vma = vma->vm_next)
   {
-    pte= caller->mm->pgd[pagenum];
-
-    if (!PAGING_PAGE_PRESENT(pte))
+    endpgn = DIV_ROUND_UP(vma->sbrk, PAGING_PAGESZ);
+    for(pagenum = PAGING_PGN(vma->vm_start); pagenum < endpgn; pagenum++)
     {
-      fpn = PAGING_PTE_FPN(pte);
-      MEMPHY_put_freefp(caller->mram, fpn);
-    } else {
-      fpn = PAGING_PTE_SWP(pte);
-      MEMPHY_put_freefp(caller->active_mswp, fpn);    
+      pte = caller->mm->pgd[pagenum];
+
+      if (!PAGING_PAGE_PRESENT(pte)) /* never mapped */
+        continue;
+      if (pte & PAGING_PTE_SWAPPED_MASK)
+        MEMPHY_put_freefp(caller->active_mswp, PAGING_PTE_SWP(pte));
+      else
+        MEMPHY_put_freefp(caller->mram, PAGING_PTE_FPN(pte));
+      caller->mm->pgd[pagenum] = 0;
     }
   }
+  pthread_mutex_unlock(&caller->mm->lock);
 
   return 0;
 }
@@ -1,8 +1,14 @@
 
 #include "loader.h"
+#include "arena.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 static uint32_t avail_pid = 1;
 
@@ -32,65 +38,108 @@ static enum ins_opcode_t get_opcode(char * opt) {
 	}
 }
 
-struct pcb_t * load(const char * path) {
-	/* Create new PCB for the new process */
-	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
-	proc->page_table =
-		(struct page_table_t*)malloc(sizeof(struct page_table_t));
-	proc->bp = PAGE_SIZE;
-	proc->pc = 0;
-	/* Read process code from file */
-	FILE * file;
-	if ((file = fopen(path, "r")) == NULL) {
-		printf("Cannot find process description at '%s'\n", path);
-		exit(1);		
-	}
-	snprintf(proc->path, 2*sizeof(path)+1, "%s", path);
+/*
+ * Program cache, a hash table of the parsed programs keyed by path. It
+ * holds a reference to each code segment until loader_destroy(), so a
+ * program is only parsed the first time it is loaded. Entries and paths
+ * live in an arena, the processes point at the path of their entry.
+ */
+#define PROG_HASH_SZ	64
+
+struct prog_entry {
+	char * path;
+	uint32_t priority;
+	struct code_seg_t * code;
+	struct prog_entry * next;
+};
+
+static struct prog_entry * prog_hash[PROG_HASH_SZ];
+static struct arena_t prog_arena;
+static pthread_mutex_t prog_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int hash_path(const char * path) {
+	unsigned int h = 5381;
+
+	while (*path)
+		h = h * 33 + (unsigned char) *path++;
+	return h % PROG_HASH_SZ;
+}
+
+/* Map the binary program [fd] of [hdr], NULL if it is malformed */
+static struct code_seg_t * map_code(int fd, const struct prog_header * hdr) {
+	struct code_seg_t * code;
+	struct stat st;
+	size_t len = sizeof(struct prog_header) +
+		(size_t) hdr->size * sizeof(struct inst_t);
+	void * map;
+
+	if (hdr->version != PROG_VERSION || fstat(fd, &st) < 0 ||
+			(size_t) st.st_size != len)
+		return NULL;
+	map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+	code->text = (struct inst_t*)((char*)map + sizeof(struct prog_header));
+	code->size = hdr->size;
+	code->refcount = 1;
+	code->map_size = len;
+	return code;
+}
+
+/* Parse the text program [file] */
+static struct code_seg_t * parse_code(FILE * file, uint32_t * priority) {
 	char opcode[10];
-	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
-	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
+	struct code_seg_t * code =
+		(struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+	if (fscanf(file, "%u %u", priority, &code->size) != 2) {
+		/* Not a program, it exits right away */
+		*priority = 0;
+		code->size = 0;
+	}
+	code->text = (struct inst_t*)malloc(
+		sizeof(struct inst_t) * code->size
 	);
+	code->refcount = 1;
+	code->map_size = 0;
 	
 	uint32_t i = 0;
 	char buf[200];
-	for (i = 0; i < proc->code->size; i++) {
+	for (i = 0; i < code->size; i++) {
 		fscanf(file, "%s", opcode);
-		proc->code->text[i].opcode = get_opcode(opcode);
-		switch(proc->code->text[i].opcode) {
+		code->text[i].opcode = get_opcode(opcode);
+		switch(code->text[i].opcode) {
 		case CALC:
 			break;
 		case ALLOC:
 			fscanf(
 				file,
 				"%u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1
+				&code->text[i].arg_0,
+				&code->text[i].arg_1
 			);
 			break;
 		case FREE:
-			fscanf(file, "%u\n", &proc->code->text[i].arg_0);
+			fscanf(file, "%u\n", &code->text[i].arg_0);
 			break;
 		case READ:
 		case WRITE:
 			fscanf(
 				file,
 				"%u %u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1,
-				&proc->code->text[i].arg_2
+				&code->text[i].arg_0,
+				&code->text[i].arg_1,
+				&code->text[i].arg_2
 			);
 			break;	
 		case SYSCALL:
 			fgets(buf, sizeof(buf), file);
 			sscanf(buf, "%d%d%d%d",
-			           &proc->code->text[i].arg_0,
-			           &proc->code->text[i].arg_1,
-			           &proc->code->text[i].arg_2,
-			           &proc->code->text[i].arg_3
+			           &code->text[i].arg_0,
+			           &code->text[i].arg_1,
+			           &code->text[i].arg_2,
+			           &code->text[i].arg_3
 			);
 			break;
 		default:
@@ -98,8 +147,140 @@ struct pcb_t * load(const char * path) {
 			exit(1);
 		}
 	}
-	return proc;
+	return code;
 }
 
+struct code_seg_t * load_code(const char * path, uint32_t * priority) {
+	struct code_seg_t * code = NULL;
+	struct prog_header hdr;
+	FILE * file;
+	if ((file = fopen(path, "r")) == NULL) {
+		printf("Cannot find process description at '%s'\n", path);
+		exit(1);		
+	}
+	if (fread(&hdr, sizeof(hdr), 1, file) == 1 && hdr.magic == PROG_MAGIC) {
+		code = map_code(fileno(file), &hdr);
+		if (code == NULL) {
+			printf("Malformed binary program at '%s'\n", path);
+			exit(1);
+		}
+		*priority = hdr.priority;
+	} else {
+		rewind(file);
+		code = parse_code(file, priority);
+	}
+	fclose(file);
+	return code;
+}
 
+int save_code(const char * path, const struct code_seg_t * code,
+		uint32_t priority) {
+	struct prog_header hdr = { PROG_MAGIC, PROG_VERSION, priority,
+		code->size };
+	FILE * file;
+	int ret = 0;
+
+	if ((file = fopen(path, "wb")) == NULL)
+		return -1;
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1 ||
+			fwrite(code->text, sizeof(struct inst_t), code->size,
+				file) != code->size)
+		ret = -1;
+	if (fclose(file) != 0)
+		ret = -1;
+	return ret;
+}
+
+static struct prog_entry * find_prog(const char * path, unsigned int h) {
+	struct prog_entry * entry;
+
+	for (entry = prog_hash[h]; entry != NULL; entry = entry->next)
+		if (strcmp(entry->path, path) == 0)
+			break;
+	return entry;
+}
+
+/* Return the cached program at [path], parsing it on first use. Parsing
+ * runs outside prog_lock so that the parser threads overlap; when two of
+ * them race on one program, the first to insert it wins and the other
+ * drops its copy */
+static struct prog_entry * get_prog(const char * path) {
+	unsigned int h = hash_path(path);
+	struct prog_entry * entry;
+	struct code_seg_t * code;
+	uint32_t priority;
+
+	pthread_mutex_lock(&prog_lock);
+	entry = find_prog(path, h);
+	pthread_mutex_unlock(&prog_lock);
+	if (entry == NULL) {
+		code = load_code(path, &priority);
+		pthread_mutex_lock(&prog_lock);
+		if ((entry = find_prog(path, h)) != NULL) {
+			put_code(code);
+		} else {
+			entry = arena_alloc(&prog_arena,
+				sizeof(struct prog_entry));
+			entry->path = arena_strdup(&prog_arena, path);
+			entry->code = code;
+			entry->priority = priority;
+			entry->next = prog_hash[h];
+			prog_hash[h] = entry;
+		}
+		pthread_mutex_unlock(&prog_lock);
+	}
+	__atomic_fetch_add(&entry->code->refcount, 1, __ATOMIC_RELAXED);
+	return entry;
+}
+
+void put_code(struct code_seg_t * code) {
+	if (__atomic_sub_fetch(&code->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+		if (code->map_size > 0)
+			munmap((char*)code->text - sizeof(struct prog_header),
+				code->map_size);
+		else
+			free(code->text);
+		free(code);
+	}
+}
+
+void loader_destroy(void) {
+	struct prog_entry * entry;
+	int h;
 
+	pthread_mutex_lock(&prog_lock);
+	for (h = 0; h < PROG_HASH_SZ; h++) {
+		while ((entry = prog_hash[h]) != NULL) {
+			prog_hash[h] = entry->next;
+			put_code(entry->code);
+		}
+	}
+	arena_destroy(&prog_arena);
+	pthread_mutex_unlock(&prog_lock);
+}
+
+void assign_pid(struct pcb_t * proc) {
+	proc->pid = __atomic_fetch_add(&avail_pid, 1, __ATOMIC_RELAXED);
+}
+
+struct pcb_t * load(const char * path) {
+	struct prog_entry * prog = get_prog(path);
+
+	/* Create new PCB for the new process */
+	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
+	proc->pid = 0;	/* see assign_pid() */
+	proc->page_table =
+		(struct page_table_t*)malloc(sizeof(struct page_table_t));
+	proc->bp = PAGE_SIZE;
+	proc->pc = 0;
+	proc->queue = NULL;
+	proc->q_prev = proc->q_next = NULL;
+	proc->sched_level = 0;
+	proc->sched_gen = 0;
+	proc->vruntime = 0;
+	memset(&proc->stats, 0, sizeof(proc->stats));
+	proc->path = prog->path;
+	proc->priority = prog->priority;
+	proc->code = prog->code;
+	return proc;
+}
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 /*
  *  MEMPHY_mv_csr - move MEMPHY cursor
@@ -111,49 +112,160 @@ int MEMPHY_write(struct memphy_struct *mp, int addr, BYTE data)
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
+ *
+ *  Every frame starts free in the bitmap, filled a whole word at a time,
+ *  and the magazines start empty
  */
 int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 {
    /* This setting come with fixed constant PAGESZ */
    int numfp = mp->maxsz / pagesz;
-   struct framephy_struct *newfst, *fst;
-   int iter = 0;
+   int nwords = (numfp + FP_WORD_BITS - 1) / FP_WORD_BITS;
+   int iter;
+
+   /* Devices without frames still get usable locks, and every get or put
+    * on them fails */
+   pthread_mutex_init(&mp->fp_lock, NULL);
+   for (iter = 0; iter < FP_NR_MAGS; iter++) {
+      pthread_mutex_init(&mp->fp_mags[iter].lock, NULL);
+      mp->fp_mags[iter].nr = 0;
+   }
+   mp->fp_bitmap = mp->fp_owned = NULL;
+   mp->nr_fp = mp->nr_free_fp = 0;
+   mp->fp_hint = 0;
 
    if (numfp <= 0)
       return -1;
 
-   /* Init head of free framephy list */
-   fst = malloc(sizeof(struct framephy_struct));
-   fst->fpn = iter;
-   mp->free_fp_list = fst;
+   mp->fp_bitmap = malloc(nwords * sizeof(unsigned long));
+   for (iter = 0; iter < nwords; iter++)
+      mp->fp_bitmap[iter] = ~0UL;
+   /* No frame past the end of the device */
+   if (numfp % FP_WORD_BITS != 0)
+      mp->fp_bitmap[nwords - 1] = (1UL << (numfp % FP_WORD_BITS)) - 1;
 
-   /* We have list with first element, fill in the rest num-1 element member*/
-   for (iter = 1; iter < numfp; iter++)
-   {
-      newfst = malloc(sizeof(struct framephy_struct));
-      newfst->fpn = iter;
-      newfst->fp_next = NULL;
-      fst->fp_next = newfst;
-      fst = newfst;
-   }
+   mp->fp_owned = calloc(nwords, sizeof(unsigned long));
+   mp->nr_fp = mp->nr_free_fp = numfp;
 
    return 0;
 }
 
-int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn){
-   struct framephy_struct *fp = mp->free_fp_list;
+/* Magazine of the calling thread, threads are spread over the magazines
+ * in the order they first allocate */
+static __thread int mag_slot = -1;
+static int nr_mag_slots;
 
-   if (fp == NULL)
-      return -1;
+static struct fp_magazine *thread_mag(struct memphy_struct *mp)
+{
+   if (mag_slot < 0)
+      mag_slot = __atomic_fetch_add(&nr_mag_slots, 1, __ATOMIC_RELAXED) % FP_NR_MAGS;
+   return &mp->fp_mags[mag_slot];
+}
+
+/* Mark [fpn] as handed out */
+static void fp_own(struct memphy_struct *mp, int fpn)
+{
+   __atomic_fetch_or(&mp->fp_owned[fpn / FP_WORD_BITS],
+                     1UL << (fpn % FP_WORD_BITS), __ATOMIC_RELAXED);
+}
+
+/* Take [fpn] back, -1 if it was not handed out (a double free) */
+static int fp_disown(struct memphy_struct *mp, int fpn)
+{
+   unsigned long bit = 1UL << (fpn % FP_WORD_BITS);
+
+   if (__atomic_fetch_and(&mp->fp_owned[fpn / FP_WORD_BITS], ~bit,
+                          __ATOMIC_RELAXED) & bit)
+      return 0;
+   return -1;
+}
+
+/*
+ *  bitmap_take - move up to [max] free frames of lowest numbers out of the
+ *  bitmap into [fpn], in ascending order, under fp_lock
+ */
+static int bitmap_take(struct memphy_struct *mp, int *fpn, int max)
+{
+   int word = mp->fp_hint, n = 0;
+   unsigned long bits;
+
+   while (n < max && mp->nr_free_fp > 0) {
+      /* There is a free frame at or after the hint */
+      while (mp->fp_bitmap[word] == 0)
+         word++;
+      bits = mp->fp_bitmap[word];
+      fpn[n++] = word * FP_WORD_BITS + __builtin_ctzl(bits);
+      mp->fp_bitmap[word] = bits & (bits - 1);
+      mp->nr_free_fp--;
+      mp->fp_hint = word;
+   }
 
-   *retfpn = fp->fpn;
-   mp->free_fp_list = fp->fp_next;
+   return n;
+}
+
+/* Set [fpn] free in the bitmap, under fp_lock */
+static void bitmap_put(struct memphy_struct *mp, int fpn)
+{
+   int word = fpn / FP_WORD_BITS;
+
+   mp->fp_bitmap[word] |= 1UL << (fpn % FP_WORD_BITS);
+   mp->nr_free_fp++;
+   if (word < mp->fp_hint)
+      mp->fp_hint = word;
+}
 
-   /* MEMPHY is iteratively used up until its exhausted
-    * No garbage collector acting then it not been released
-    */
-   free(fp);
+/* Take a frame cached by the magazine of another thread, once the bitmap
+ * ran dry */
+static int mag_steal(struct memphy_struct *mp, int *retfpn)
+{
+   struct fp_magazine *mag;
+   int iter, ret = -1;
+
+   for (iter = 0; iter < FP_NR_MAGS && ret < 0; iter++) {
+      mag = &mp->fp_mags[iter];
+      pthread_mutex_lock(&mag->lock);
+      if (mag->nr > 0) {
+         *retfpn = mag->fpn[--mag->nr];
+         ret = 0;
+      }
+      pthread_mutex_unlock(&mag->lock);
+   }
 
+   return ret;
+}
+
+/*
+ *  MEMPHY_get_freefp - take a free frame, from the magazine of the calling
+ *  thread, refilled with the lowest free frames of the bitmap when empty
+ *  @mp: memphy struct
+ *  @retfpn: obtained frame
+ */
+int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn){
+   struct fp_magazine *mag = thread_mag(mp);
+   int batch[FP_MAG_BATCH];
+   int n;
+
+   pthread_mutex_lock(&mag->lock);
+   if (mag->nr == 0) {
+      pthread_mutex_lock(&mp->fp_lock);
+      n = bitmap_take(mp, batch, FP_MAG_BATCH);
+      pthread_mutex_unlock(&mp->fp_lock);
+
+      /* Lowest frame on top */
+      while (n > 0)
+         mag->fpn[mag->nr++] = batch[--n];
+   }
+   if (mag->nr > 0) {
+      *retfpn = mag->fpn[--mag->nr];
+      pthread_mutex_unlock(&mag->lock);
+      fp_own(mp, *retfpn);
+      return 0;
+   }
+   pthread_mutex_unlock(&mag->lock);
+
+   if (mag_steal(mp, retfpn) < 0)
+      return -1;
+   fp_own(mp, *retfpn);
    return 0;
 }
 
@@ -181,15 +293,143 @@ int MEMPHY_dump(struct memphy_struct *mp){
    return 0;
 }
 
-int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
+/* First free run of 2^order frames aligned on its size, within one word
+ * of the bitmap, -1 if none */
+static int bitmap_find_small_run(struct memphy_struct *mp, int order)
+{
+   int nwords = (mp->nr_fp + FP_WORD_BITS - 1) / FP_WORD_BITS;
+   int len = 1 << order, word, shift;
+   /* One bit at every multiple of len */
+   unsigned long align = len == FP_WORD_BITS ? 1 : ~0UL / ((1UL << len) - 1);
+   unsigned long runs;
+
+   for (word = mp->fp_hint; word < nwords; word++) {
+      /* Bit i stays set when bits i .. i + len - 1 are all free */
+      runs = mp->fp_bitmap[word];
+      for (shift = 1; shift < len && runs != 0; shift <<= 1)
+         runs &= runs >> shift;
+      runs &= align;
+      if (runs != 0)
+         return word * FP_WORD_BITS + __builtin_ctzl(runs);
+   }
+
+   return -1;
+}
+
+/* First free run of 2^order frames aligned on its size, over whole words
+ * of the bitmap, -1 if none */
+static int bitmap_find_large_run(struct memphy_struct *mp, int order)
+{
+   int nwords = mp->nr_fp / FP_WORD_BITS;
+   int len = 1 << (order - __builtin_ctz(FP_WORD_BITS)); /* in words */
+   int word, iter;
+
+   for (word = mp->fp_hint & ~(len - 1); word + len <= nwords; word += len) {
+      for (iter = 0; iter < len && mp->fp_bitmap[word + iter] == ~0UL; iter++)
+         ;
+      if (iter == len)
+         return word * FP_WORD_BITS;
+   }
+
+   return -1;
+}
+
+/*
+ *  MEMPHY_get_freefp_run - take a buddy block, 2^order contiguous free
+ *  frames starting at a multiple of 2^order. Frames cached in the
+ *  magazines are not part of any block
+ *  @mp: memphy struct
+ *  @order: log2 of the number of frames
+ *  @retfpn: first frame of the block
+ */
+int MEMPHY_get_freefp_run(struct memphy_struct *mp, int order, int *retfpn)
+{
+   int len = 1 << order, fpn, iter;
+
+   if (order < 0 || len > mp->nr_fp)
+      return -1;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   if (mp->nr_free_fp < len)
+      fpn = -1;
+   else if (len <= FP_WORD_BITS)
+      fpn = bitmap_find_small_run(mp, order);
+   else
+      fpn = bitmap_find_large_run(mp, order);
+   if (fpn >= 0) {
+      for (iter = fpn; iter < fpn + len; iter++)
+         mp->fp_bitmap[iter / FP_WORD_BITS] &= ~(1UL << (iter % FP_WORD_BITS));
+      mp->nr_free_fp -= len;
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   if (fpn < 0)
+      return -1;
+   for (iter = fpn; iter < fpn + len; iter++)
+      fp_own(mp, iter);
+   *retfpn = fpn;
+   return 0;
+}
+
+/*
+ *  MEMPHY_put_freefp_run - give back a block of MEMPHY_get_freefp_run,
+ *  it merges with its free buddies in the bitmap by itself
+ *  @mp: memphy struct
+ *  @fpn: first frame of the block
+ *  @order: log2 of the number of frames
+ */
+int MEMPHY_put_freefp_run(struct memphy_struct *mp, int fpn, int order)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
-   struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
+   int len = 1 << order, iter;
+
+   if (order < 0 || fpn < 0 || fpn + len > mp->nr_fp || (fpn & (len - 1)))
+      return -1;
+   for (iter = fpn; iter < fpn + len; iter++) {
+      if (fp_disown(mp, iter) < 0) {
+         /* Some frame is already free, keep the block as it was */
+         while (--iter >= fpn)
+            fp_own(mp, iter);
+         return -1;
+      }
+   }
+
+   pthread_mutex_lock(&mp->fp_lock);
+   for (iter = fpn; iter < fpn + len; iter++)
+      bitmap_put(mp, iter);
+   pthread_mutex_unlock(&mp->fp_lock);
 
-   /* Create new node with value fpn */
-   newnode->fpn = fpn;
-   newnode->fp_next = fp;
-   mp->free_fp_list = newnode;
+   return 0;
+}
+
+/*
+ *  MEMPHY_put_freefp - give a frame back to the magazine of the calling
+ *  thread, which drains its oldest frames to the bitmap when full. A
+ *  frame that is already free is rejected
+ *  @mp: memphy struct
+ *  @fpn: freed frame
+ */
+int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
+{
+   struct fp_magazine *mag = thread_mag(mp);
+   int iter;
+
+   if (fpn < 0 || fpn >= mp->nr_fp)
+      return -1; /* not a frame of the device */
+   if (fp_disown(mp, fpn) < 0)
+      return -1; /* already free */
+
+   pthread_mutex_lock(&mag->lock);
+   if (mag->nr == FP_MAG_SIZE) {
+      pthread_mutex_lock(&mp->fp_lock);
+      for (iter = 0; iter < FP_MAG_BATCH; iter++)
+         bitmap_put(mp, mag->fpn[iter]);
+      pthread_mutex_unlock(&mp->fp_lock);
+
+      mag->nr -= FP_MAG_BATCH;
+      memmove(mag->fpn, mag->fpn + FP_MAG_BATCH, mag->nr * sizeof(int));
+   }
+   mag->fpn[mag->nr++] = fpn;
+   pthread_mutex_unlock(&mag->lock);
 
    return 0;
 }
@@ -199,9 +439,9 @@ int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
  */
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
 {
-   mp->storage = (BYTE *)malloc(max_size * sizeof(BYTE));
+   /* Zeroed pages are only backed once touched */
+   mp->storage = (BYTE *)calloc(max_size, sizeof(BYTE));
    mp->maxsz = max_size;
-   memset(mp->storage, 0, max_size * sizeof(BYTE));
 
    MEMPHY_format(mp, PAGING_PAGESZ);
 
@@ -0,0 +1,185 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Software TLB module mm/mm-tlb.c
+ *
+ * Each CPU caches the translations pgn -> fpn of the processes it runs in
+ * a direct-mapped TLB, tagged with the ASID (pid) of the process, so they
+ * survive context switches. The host thread stepping a CPU points
+ * tlb_cur at its TLB, so lookups take no lock. A process changes its
+ * page table while it runs, and pte_set_fpn/pte_set_swap drop the entry
+ * from the TLB of its CPU. Its entries left on a CPU are only stale if
+ * it ran elsewhere since, then they are dropped when it comes back. A
+ * page table changed away from any CPU bumps tlb_gen, which flushes
+ * every TLB at its next switch.
+ */
+
+#include "mm.h"
+#include <stdlib.h>
+
+struct tlb_entry {
+   int asid; /* -1 if invalid */
+   int pgn;
+   int fpn;
+};
+
+struct tlb_struct {
+   struct tlb_entry *entries;
+   uint32_t *pgd; /* page table of the running process */
+   int asid;
+   unsigned long gen; /* tlb_gen of the last flush */
+   unsigned long hits;
+   unsigned long misses;
+};
+
+static struct tlb_struct *tlbs;
+static int nr_tlbs;
+static int tlb_size; /* entries per TLB, a power of two, 0 if disabled */
+static __thread struct tlb_struct *tlb_cur;
+static unsigned long tlb_gen; /* page tables changed outside their CPU */
+
+/*
+ *  tlb_init - create one TLB of [size] entries per CPU
+ *  @nr_cpus: number of CPUs
+ *  @size: entries per TLB, a power of two, 0 disables the TLBs
+ */
+int tlb_init(int nr_cpus, int size)
+{
+   int cpu, iter;
+
+   if (size < 0 || (size & (size - 1)) != 0)
+      return -1;
+
+   tlb_size = size;
+   nr_tlbs = nr_cpus;
+   tlbs = calloc(nr_cpus, sizeof(struct tlb_struct));
+   for (cpu = 0; cpu < nr_cpus; cpu++) {
+      tlbs[cpu].entries = malloc(size * sizeof(struct tlb_entry));
+      for (iter = 0; iter < size; iter++)
+         tlbs[cpu].entries[iter].asid = -1;
+      tlbs[cpu].asid = -1;
+   }
+
+   return 0;
+}
+
+void tlb_destroy(void)
+{
+   int cpu;
+
+   for (cpu = 0; cpu < nr_tlbs; cpu++)
+      free(tlbs[cpu].entries);
+   free(tlbs);
+   tlbs = NULL;
+   nr_tlbs = 0;
+}
+
+/*
+ *  tlb_switch - make the TLB of [cpu] the one of the calling thread, for
+ *  the process [proc] it runs
+ */
+void tlb_switch(int cpu, struct pcb_t *proc)
+{
+   struct tlb_struct *tlb = &tlbs[cpu];
+   unsigned long gen = __atomic_load_n(&tlb_gen, __ATOMIC_ACQUIRE);
+   int iter;
+
+   if (tlb->gen != gen) {
+      for (iter = 0; iter < tlb_size; iter++)
+         tlb->entries[iter].asid = -1;
+      tlb->gen = gen;
+   } else if (proc->mm->tlb_cpu != cpu) {
+      /* Its page table may have changed on another CPU */
+      for (iter = 0; iter < tlb_size; iter++)
+         if (tlb->entries[iter].asid == proc->pid)
+            tlb->entries[iter].asid = -1;
+   }
+   proc->mm->tlb_cpu = cpu;
+   tlb->asid = proc->pid;
+   tlb->pgd = proc->mm->pgd;
+   tlb_cur = tlb;
+}
+
+/*
+ *  tlb_lookup - translate [pgn] of address space [asid]
+ *  @fpn: return FPN on a hit
+ *
+ *  Return 0 on a hit, -1 on a miss
+ */
+int tlb_lookup(int asid, int pgn, int *fpn)
+{
+   struct tlb_struct *tlb = tlb_cur;
+   struct tlb_entry *e;
+
+   if (tlb == NULL || tlb_size == 0)
+      return -1;
+
+   e = &tlb->entries[pgn & (tlb_size - 1)];
+   if (e->asid == asid && e->pgn == pgn) {
+      tlb->hits++;
+      *fpn = e->fpn;
+      return 0;
+   }
+   tlb->misses++;
+
+   return -1;
+}
+
+/*
+ *  tlb_fill - cache the translation of [pgn] to [fpn] of address space
+ *  [asid], if it runs on the CPU of the calling thread
+ */
+void tlb_fill(int asid, int pgn, int fpn)
+{
+   struct tlb_struct *tlb = tlb_cur;
+   struct tlb_entry *e;
+
+   if (tlb == NULL || tlb_size == 0 || tlb->asid != asid)
+      return;
+
+   e = &tlb->entries[pgn & (tlb_size - 1)];
+   e->asid = asid;
+   e->pgn = pgn;
+   e->fpn = fpn;
+}
+
+/*
+ *  tlb_invalidate_pte - drop the cached translation of [pte]. If it is not
+ *  an entry of the page table of the process running on the calling
+ *  thread, any TLB may cache it: flush them all
+ */
+void tlb_invalidate_pte(uint32_t *pte)
+{
+   struct tlb_struct *tlb = tlb_cur;
+   struct tlb_entry *e;
+   int pgn;
+
+   if (tlb_size == 0)
+      return;
+   if (tlb == NULL || tlb->pgd == NULL ||
+       pte < tlb->pgd || pte >= tlb->pgd + PAGING_MAX_PGN) {
+      __atomic_fetch_add(&tlb_gen, 1, __ATOMIC_RELEASE);
+      return;
+   }
+
+   pgn = pte - tlb->pgd;
+   e = &tlb->entries[pgn & (tlb_size - 1)];
+   if (e->asid == tlb->asid && e->pgn == pgn)
+      e->asid = -1;
+}
+
+/*
+ *  tlb_stats - hits and misses of every TLB, once the CPUs stopped
+ */
+void tlb_stats(unsigned long *hits, unsigned long *misses)
+{
+   int cpu;
+
+   *hits = *misses = 0;
+   for (cpu = 0; cpu < nr_tlbs; cpu++) {
+      *hits += tlbs[cpu].hits;
+      *misses += tlbs[cpu].misses;
+   }
+}
+
+// #endif
@@ -7,6 +7,8 @@
 #include "mm.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 
 /*
  * init_pte - Initialize PTE entry
@@ -19,6 +21,7 @@ int init_pte(uint32_t *pte,
              int swptyp, // swap type
              int swpoff) // swap offset
 {
+  tlb_invalidate_pte(pte);
   if (pre != 0) {
     if (swp == 0) { // Non swap ~ page online
       if (fpn == 0)
@@ -53,6 +56,7 @@ int init_pte(uint32_t *pte,
  */
 int pte_set_swap(uint32_t *pte, int swptyp, int swpoff)
 {
+  tlb_invalidate_pte(pte);
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
 
@@ -69,6 +73,7 @@ int pte_set_swap(uint32_t *pte, int swptyp, int swpoff)
  */
 int pte_set_fpn(uint32_t *pte, int fpn)
 {
+  tlb_invalidate_pte(pte);
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
 
@@ -94,53 +99,84 @@ int vmap_page_range(struct pcb_t *caller,           // process call
   ret_rg->rg_start = addr;
   ret_rg->rg_end = addr + pgnum * PAGING_PAGESZ;
   
-  /* Map each page in range to corresponding frame */
-  for(int pgit = 0; pgit < pgnum; pgit++){
+  /* Map each page in range to corresponding frame, a run of contiguous
+   * frames at a time */
+  for(int pgit = 0; pgit < pgnum; fpit = fpit->fp_next){
     if(fpit == NULL) // Not enough physical frames to map
       break;
 
-    // Set page table entry for virtual page number
-    pte_set_fpn(&caller->mm->pgd[pgn + pgit], fpit->fpn);
-    // Enqueue the page into FIFO list (used for page replacement tracking)
-    enlist_pgn_node(&caller->mm->fifo_pgn, pgn + pgit);
-
-    fpit = fpit->fp_next;
+    for(int fpit_off = 0; fpit_off < fpit->fpcount && pgit < pgnum; fpit_off++, pgit++){
+      // Set page table entry for virtual page number
+      pte_set_fpn(&caller->mm->pgd[pgn + pgit], fpit->fpn + fpit_off);
+      // Enqueue the page into FIFO list (used for page replacement tracking)
+      enlist_pgn_node(&caller->mm->fifo_pgn, pgn + pgit);
+    }
   }
 
   return 0;
 }
 
+/*
+ * free_frame_list - release the nodes of a frame list, and their frames
+ * too when [put] is set
+ */
+static void free_frame_list(struct memphy_struct *mram, struct framephy_struct *frm_lst, int put){
+  struct framephy_struct *fpit;
+
+  while((fpit = frm_lst) != NULL){
+    frm_lst = fpit->fp_next;
+    if(put && fpit->fpcount > 1)
+      MEMPHY_put_freefp_run(mram, fpit->fpn, __builtin_ctz(fpit->fpcount));
+    else if(put)
+      MEMPHY_put_freefp(mram, fpit->fpn);
+    free(fpit);
+  }
+}
+
 /*
  * alloc_pages_range - allocate req_pgnum of frame in ram
  * @caller    : caller
  * @req_pgnum : request page num
- * @frm_lst   : frame list
+ * @frm_lst   : frame list, one node per run of contiguous frames
+ *
+ * Large requests are served with buddy blocks as large as they fit, the
+ * rest frame by frame
  */
 int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst){
   struct framephy_struct *newfp_str;
-
-  // Attempt to alloc each required page
-  for (int pgit = 0; pgit < req_pgnum; pgit++){
-    int fpn;    
-    // Try to get a free frame page from MEMRAM
-    if (MEMPHY_get_freefp(caller->mram, &fpn) == 0){
-      newfp_str = malloc(sizeof(struct framephy_struct));
-      newfp_str->owner = caller->mm; // Link frame to current mm
-      newfp_str->fpn = fpn;
-      
-      // Push to front of frame list
-      newfp_str->fp_next = *frm_lst;
-      *frm_lst = newfp_str;
-    }
-    else{ // Not enough free frames => rollback and return error
-      while(*frm_lst != NULL){
-        // Release previously allocated frames
-        MEMPHY_put_freefp(caller->mram, (*frm_lst)->fpn);
-        *frm_lst = (*frm_lst)->fp_next;
+  int maxorder = 30; // no block above it is left
+  int pgit = 0, fpn, order;
+
+  while (pgit < req_pgnum){
+    order = 31 - __builtin_clz(req_pgnum - pgit);
+    if (order > maxorder)
+      order = maxorder;
+    for (; order >= FP_RUN_MIN_ORDER; order--)
+      if (MEMPHY_get_freefp_run(caller->mram, order, &fpn) == 0)
+        break;
+    maxorder = order;
+
+    if (order < FP_RUN_MIN_ORDER){
+      order = 0;
+      // Try to get a free frame page from MEMRAM
+      if (MEMPHY_get_freefp(caller->mram, &fpn) < 0){
+        // Not enough free frames => rollback and return error
+        free_frame_list(caller->mram, *frm_lst, 1);
+        *frm_lst = NULL;
+
+        return -3000; // ERR: partial allocation failure
       }
-
-      return -3000; // ERR: partial allocation failure
     }
+
+    newfp_str = malloc(sizeof(struct framephy_struct));
+    newfp_str->owner = caller->mm; // Link frame to current mm
+    newfp_str->fpn = fpn;
+    newfp_str->fpcount = 1 << order;
+
+    // Push to front of frame list
+    newfp_str->fp_next = *frm_lst;
+    *frm_lst = newfp_str;
+    pgit += 1 << order;
   }
   return 0;
 }
@@ -183,6 +219,7 @@ int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int inc
   /* it leaves the case of memory is enough but half in ram, half in swap
    * do the swaping all to swapper to get the all in ram */
   vmap_page_range(caller, mapstart, incpgnum, frm_lst, ret_rg);
+  free_frame_list(caller->mram, frm_lst, 0);
 
   return 0;
 }
@@ -197,6 +234,14 @@ int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                    struct memphy_struct *mpdst, int dstfpn){
   int cellidx;
   int addrsrc, addrdst;
+
+  /* Random access devices copy the whole page at once */
+  if (mpsrc->rdmflg && mpdst->rdmflg){
+    memcpy(mpdst->storage + dstfpn * PAGING_PAGESZ,
+           mpsrc->storage + srcfpn * PAGING_PAGESZ, PAGING_PAGESZ);
+    return 0;
+  }
+
   for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++){
     addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
     addrdst = dstfpn * PAGING_PAGESZ + cellidx;
@@ -218,7 +263,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
 {
   struct vm_area_struct *vma0 = malloc(sizeof(struct vm_area_struct));
 
-  mm->pgd = malloc(PAGING_MAX_PGN * sizeof(uint32_t));
+  mm->pgd = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
 
   /* By default the owner comes with at least one vma */
   vma0->vm_id = 0;
@@ -226,6 +271,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma0->vm_end = vma0->vm_start;
   vma0->sbrk = vma0->vm_start;
   struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
+  vma0->vm_freerg_list = NULL;
   enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
 
   /* TODO update VMA0 next */
@@ -236,6 +282,10 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
 
   /* TODO: update mmap */
   mm->mmap = vma0;
+  mm->fifo_pgn = NULL;
+  memset(mm->symrgtbl, 0, sizeof(mm->symrgtbl));
+  pthread_mutex_init(&mm->lock, NULL);
+  mm->tlb_cpu = -1;
 
   /* Bonus */
   caller->mm = mm;
@@ -243,6 +293,34 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   return 0;
 }
 
+/*
+ * free_mm - Release the vmas, lists and page table of an mm, the frames
+ * are given back by free_pcb_memph
+ * @mm:     self mm
+ */
+void free_mm(struct mm_struct *mm)
+{
+  struct vm_area_struct *vma;
+  struct vm_rg_struct *rg;
+  struct pgn_t *pg;
+
+  while ((vma = mm->mmap) != NULL) {
+    mm->mmap = vma->vm_next;
+    while ((rg = vma->vm_freerg_list) != NULL) {
+      vma->vm_freerg_list = rg->rg_next;
+      free(rg);
+    }
+    free(vma);
+  }
+  while ((pg = mm->fifo_pgn) != NULL) {
+    mm->fifo_pgn = pg->pg_next;
+    free(pg);
+  }
+  free(mm->pgd);
+  mm->pgd = NULL;
+  pthread_mutex_destroy(&mm->lock);
+}
+
 struct vm_rg_struct *init_vm_rg(int rg_start, int rg_end)
 {
   struct vm_rg_struct *rgnode = malloc(sizeof(struct vm_rg_struct));
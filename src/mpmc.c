@@ -0,0 +1,85 @@
+
+#include "mpmc.h"
+#include <stdlib.h>
+
+struct mpmc_ring * mpmc_create(unsigned long capacity) {
+	struct mpmc_ring * ring;
+	unsigned long size = 2, i;
+
+	while (size < capacity)
+		size <<= 1;
+
+	ring = malloc(sizeof(struct mpmc_ring) + size * sizeof(struct mpmc_cell));
+	ring->mask = size - 1;
+	ring->enq_pos = 0;
+	ring->deq_pos = 0;
+	for (i = 0; i < size; i++) {
+		ring->cells[i].seq = i;
+		ring->cells[i].proc = NULL;
+	}
+	return ring;
+}
+
+void mpmc_destroy(struct mpmc_ring * ring) {
+	free(ring);
+}
+
+int mpmc_push(struct mpmc_ring * ring, struct pcb_t * proc) {
+	struct mpmc_cell * cell;
+	unsigned long pos = __atomic_load_n(&ring->enq_pos, __ATOMIC_RELAXED);
+
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		unsigned long seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		long dif = (long)seq - (long)pos;
+
+		if (dif == 0) {
+			/* Cell is free for this lap, try to claim it */
+			if (__atomic_compare_exchange_n(&ring->enq_pos, &pos, pos + 1,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return -1; // Full
+		} else {
+			pos = __atomic_load_n(&ring->enq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->proc = proc;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+struct pcb_t * mpmc_pop(struct mpmc_ring * ring) {
+	struct mpmc_cell * cell;
+	struct pcb_t * proc;
+	unsigned long pos = __atomic_load_n(&ring->deq_pos, __ATOMIC_RELAXED);
+
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		unsigned long seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		long dif = (long)seq - (long)(pos + 1);
+
+		if (dif == 0) {
+			/* Cell is filled for this lap, try to claim it */
+			if (__atomic_compare_exchange_n(&ring->deq_pos, &pos, pos + 1,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return NULL; // Empty
+		} else {
+			pos = __atomic_load_n(&ring->deq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	proc = cell->proc;
+	__atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+	return proc;
+}
+
+int mpmc_empty(struct mpmc_ring * ring) {
+	unsigned long deq = __atomic_load_n(&ring->deq_pos, __ATOMIC_ACQUIRE);
+	unsigned long enq = __atomic_load_n(&ring->enq_pos, __ATOMIC_ACQUIRE);
+
+	return enq <= deq;
+}
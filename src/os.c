@@ -5,16 +5,28 @@
 #include "queue.h"
 #include "loader.h"
 #include "mm.h"
+#include "stats.h"
+#include "des.h"
+#include "coro.h"
+#include "ldpool.h"
 
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <semaphore.h>
+#include <getopt.h>
+#include <limits.h>
+#include <unistd.h>
 
 static int time_slot;
 static int num_cpus;
 static int done = 0;
+static int batch = 0;
+static int reclaim = 0;	/* give frames back when a process exits */
+static int tlb_entries = 64;	/* per-CPU TLB size, 0 disables it */
+static uint64_t nr_insts;	/* instructions run on every CPU */
+static uint64_t next_admission;	/* slot the loader thread admits at next */
 
 #ifdef MM_PAGING
 static int memramsz;
@@ -31,13 +43,14 @@ struct mmpaging_ld_args {
 };
 #endif
 
-static struct ld_args{
-	char ** path;
-	unsigned long * start_time;
-#ifdef MLQ_SCHED
-	unsigned long * prio;
-#endif
-} ld_processes;
+/* Config being read, the process entries are streamed by the loader */
+static struct config {
+	FILE * file;
+	char * line;
+	size_t line_cap;
+	int nr_read;		/* process entries read so far */
+	int pending;		/* [line] holds the next entry already */
+} config;
 int num_processes;
 
 struct cpu_args {
@@ -48,129 +61,467 @@ struct cpu_args {
 sem_t sync_sem;
 static int num_act_cpus;
 
+/* State of one simulated CPU between two time slots */
+struct cpu_state {
+	int id;
+	int time_left;
+	int ticks;		/* slots used by the last step */
+	int max_ticks;		/* slots the next step may use */
+	struct pcb_t * proc;
+};
+
+enum cpu_status {
+	CPU_BUSY,	/* ran an instruction */
+	CPU_IDLE,	/* nothing to run in this slot */
+	CPU_STOPPED,	/* nothing left to run at all */
+};
+
+/* Next instruction of [proc] only uses the CPU, so running it early
+ * cannot be told apart by the other CPUs */
+static int cpu_only(struct pcb_t * proc) {
+	return proc->pc < proc->code->size &&
+		proc->code->text[proc->pc].opcode == CALC;
+}
+
+/* Slots a step starting at slot [now] may use. Arrivals due at slot
+ * [admission] run from the next one on and a policy may preempt on
+ * them, so a batch stops there */
+static int step_ticks(uint64_t now, uint64_t admission) {
+	if (!batch)
+		return 1;
+	if (admission == TIMER_NO_EVENT)
+		return INT_MAX;
+	if (admission < now)
+		return 1;
+	return admission + 1 - now > INT_MAX ? INT_MAX : admission + 1 - now;
+}
+
+/* Simulate one time slot of CPU [cs], or up to [cs->max_ticks] slots of
+ * the time slice as long as the process only computes. Shared by every
+ * engine */
+static enum cpu_status cpu_step(struct cpu_state * cs) {
+	int id = cs->id;
+	struct pcb_t * proc = cs->proc;
+
+	/* Check the status of current process */
+	if (proc == NULL) {
+		/* No process is running, the we load new process from
+		 * ready queue */
+		proc = get_proc(id);
+	}else if (proc->pc == proc->code->size) {
+		/* The porcess has finish it job */
+		printf("\tCPU %d: Processed %2d has finished\n",
+			id ,proc->pid);
+		finish_proc(id, proc);
+#ifdef MM_PAGING
+		if (reclaim)
+			free_pcb_memph(proc);
+		free_mm(proc->mm);
+		free(proc->mm);
+#endif
+		put_code(proc->code);
+		free(proc->page_table);
+		free(proc);
+		proc = get_proc(id);
+		cs->time_left = 0;
+	}else if (cs->time_left == 0) {
+		/* The process has done its job in current time slot */
+		printf("\tCPU %d: Put process %2d to run queue\n",
+			id, proc->pid);
+		put_proc(id, proc);
+		proc = get_proc(id);
+	}
+	cs->proc = proc;
+
+	/* Recheck process status after loading new process */
+	if (proc == NULL && done) {
+		/* No process to run, exit */
+		printf("\tCPU %d stopped\n", id);
+		return CPU_STOPPED;
+	}else if (proc == NULL) {
+		/* There may be new processes to run in
+		 * next time slots, just skip current slot */
+		return CPU_IDLE;
+	}else if (cs->time_left == 0) {
+		printf("\tCPU %d: Dispatched process %2d\n",
+			id, proc->pid);
+		cs->time_left = sched_slice(id, proc);
+	}
+#ifdef MM_PAGING
+	tlb_switch(id, proc);
+#endif
+
+	/* Run current process */
+	cs->ticks = 0;
+	do {
+		run(proc);
+		cs->ticks++;
+		cs->time_left--;
+		/* The policy may cut the slice short */
+		if (sched_tick(id, proc))
+			cs->time_left = 0;
+	} while (cs->ticks < cs->max_ticks && cs->time_left > 0 &&
+			cpu_only(proc));
+	__atomic_fetch_add(&nr_insts, cs->ticks, __ATOMIC_RELAXED);
+	return CPU_BUSY;
+}
+
 static void * cpu_routine(void * args) {
 	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
-	int id = ((struct cpu_args*)args)->id;
-	/* Check for new process in ready queue */
-	int time_left = 0;
-	struct pcb_t * proc = NULL;
-	while (1) {
-		// while(turn == 0); // wait
-		/* Check the status of current process */
-		if (proc == NULL) {
-			/* No process is running, the we load new process from
-		 	* ready queue */
-			proc = get_proc();
-			if (proc == NULL) {
-				if(done){ // avoid inf loop
-					printf("\tCPU %d stopped\n", id);
-					break;
-				}
-				sem_post(&sync_sem);
-                next_slot(timer_id);
-                continue; /* First load failed. skip dummy load */
-            }
-		}else if (proc->pc == proc->code->size) {
-			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-				id ,proc->pid);
-			peek_at_id(proc->running_list, proc->pid);
-			free(proc);
-			proc = get_proc();
-			time_left = 0;
-		}else if (time_left == 0) {
-			/* The process has done its job in current time slot */
-			printf("\tCPU %d: Put process %2d to run queue\n",
-				id, proc->pid);
-			put_proc(proc);
-			proc = get_proc();
-		}
-		
-		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
-			/* No process to run, exit */
-			printf("\tCPU %d stopped\n", id);
+	struct cpu_state cs = { ((struct cpu_args*)args)->id, 0, 0, 1, NULL };
+	enum cpu_status status;
+	int i;
+
+	for (;;) {
+		cs.max_ticks = step_ticks(current_time(),
+			__atomic_load_n(&next_admission, __ATOMIC_ACQUIRE));
+		if ((status = cpu_step(&cs)) == CPU_STOPPED)
 			break;
-		}else if (proc == NULL) {
-			/* There may be new processes to run in
-			 * next time slots, just skip current slot */
+		if (status == CPU_BUSY) {
+			/* Account every slot of a batch to the loader, which
+			 * must not wait for us while we are away */
+			for (i = 0; i < cs.ticks; i++)
+				sem_post(&sync_sem);
+			next_slots(timer_id, cs.ticks);
+		} else {
 			sem_post(&sync_sem);
-			next_slot(timer_id);
-			continue;
-		}else if (time_left == 0) {
-			printf("\tCPU %d: Dispatched process %2d\n",
-				id, proc->pid);
-			time_left = time_slot;
+			next_slot_until(timer_id, TIMER_NO_EVENT);
 		}
-		
-		/* Run current process */
-		run(proc);
-		time_left--;
-		
-		sem_post(&sync_sem); 
-		next_slot(timer_id);
-		
 	}
 	detach_event(timer_id);
-	num_act_cpus--;
-	pthread_exit(NULL);
+	__atomic_fetch_sub(&num_act_cpus, 1, __ATOMIC_SEQ_CST);
+	/* Return rather than exit, this also runs as a coroutine */
+	return NULL;
+}
+
+/* Load the process of [e], on a parser thread */
+static struct pcb_t * load_proc(struct ld_entry * e) {
+	struct pcb_t * proc = load(e->path);
+#ifdef MLQ_SCHED
+	proc->prio = e->prio;
+#endif
+	return proc;
+}
+
+/* Give the process of [e] its PID and memory and queue it. [args] are
+ * the loader arguments */
+static void admit_proc(struct ld_entry * e, void * args) {
+	struct pcb_t * proc = e->proc;
+#ifdef MM_PAGING
+	struct mmpaging_ld_args * ld_args = (struct mmpaging_ld_args *)args;
+
+	proc->mm = malloc(sizeof(struct mm_struct));
+	init_mm(proc->mm, proc);
+	proc->mram = ld_args->mram;
+	proc->mswp = ld_args->mswp;
+	proc->active_mswp = ld_args->active_mswp;
+#endif
+	assign_pid(proc);
+	printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
+		proc->path, proc->pid, e->prio);
+	add_proc(proc);
+}
+
+/* Admit the process of [e] and every next one due by slot [now]
+ * together, they are already loaded by the parser pool. Return the
+ * first entry left, NULL at the end of the config */
+static struct ld_entry * admit_due(struct ld_entry * e, uint64_t now,
+		void * args) {
+	do {
+		admit_proc(e, args);
+		ldpool_take();
+	} while ((e = ldpool_peek()) != NULL && e->start_time <= now);
+	return e;
 }
 
 static void * ld_routine(void * args) {
 #ifdef MM_PAGING
-	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
-	struct memphy_struct** mswp = ((struct mmpaging_ld_args *)args)->mswp;
-	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
 	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-	int i = 0;
+	struct ld_entry * e = ldpool_peek();
 	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
-#ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
-#endif
+	while (e != NULL) {
+		__atomic_store_n(&next_admission, e->start_time,
+			__ATOMIC_RELEASE);
 		for (int i = 0; i < num_act_cpus; i++) {
 			sem_wait(&sync_sem); 
 		}
-		while (current_time() < ld_processes.start_time[i]) {
-			next_slot(timer_id);
+		while (current_time() < e->start_time) {
+			next_slot_until(timer_id, e->start_time);
+		}
+		e = admit_due(e, current_time(), args);
+		next_slot(timer_id);
+	}
+	__atomic_store_n(&next_admission, TIMER_NO_EVENT, __ATOMIC_RELEASE);
+	done = 1;
+	detach_event(timer_id);
+	pthread_exit(NULL);
+}
+
+/*
+ * Discrete-event engine: the loader and every CPU are stepped from one
+ * thread, in (time slot, CPU id, loader) order, so a run is
+ * deterministic and costs no host context switch. The loader goes last
+ * like the loader thread, which only admits once every CPU is done with
+ * the slot, so arrivals run from the next slot on. A CPU that finds
+ * nothing to run is parked until something may have changed: a new
+ * arrival, or a busy CPU leaving work to steal in the next slot. Slots
+ * where nothing can happen are skipped.
+ */
+static void des_routine(void * args) {
+	struct cpu_state * cpus = malloc(num_cpus * sizeof(struct cpu_state));
+	char * parked = calloc(num_cpus, 1);
+	struct des_queue events;
+	struct des_event ev;
+	struct ld_entry * e = ldpool_peek();
+	uint64_t now = 0, next;
+	int nr_parked = 0, printed = 0, i;
+
+	des_init(&events, num_cpus + 1);
+	des_push(&events, e != NULL ? e->start_time : 0, DES_LOAD, 0);
+	for (i = 0; i < num_cpus; i++) {
+		cpus[i].id = i;
+		cpus[i].time_left = 0;
+		cpus[i].ticks = 0;
+		cpus[i].max_ticks = 1;
+		cpus[i].proc = NULL;
+		des_push(&events, 0, DES_CPU, i);
+	}
+
+	printf("ld_routine\n");
+	while (des_pop(&events, &ev) == 0) {
+		if (!printed || ev.time != now) {
+			now = ev.time;
+			set_time(now);
+			printf("Time slot %3lu\n", now);
+			printed = 1;
+		}
+
+		if (ev.type == DES_LOAD) {
+			if (e != NULL) {
+				e = admit_due(e, now, args);
+				next = e != NULL ? e->start_time : now + 1;
+				des_push(&events, next, DES_LOAD, 0);
+			} else {
+				done = 1;
+			}
+			next = now + 1;	// wake parked CPUs
+		} else {
+			cpus[ev.id].max_ticks = step_ticks(now,
+				e != NULL ? e->start_time : TIMER_NO_EVENT);
+			switch (cpu_step(&cpus[ev.id])) {
+			case CPU_BUSY:
+				des_push(&events, now + cpus[ev.id].ticks,
+					DES_CPU, ev.id);
+				next = now + 1;
+				break;
+			case CPU_IDLE:
+				parked[ev.id] = 1;
+				nr_parked++;
+				continue;
+			default:
+				continue;
+			}
+		}
+
+		for (i = 0; i < num_cpus && nr_parked > 0; i++) {
+			if (parked[i]) {
+				parked[i] = 0;
+				nr_parked--;
+				des_push(&events, next, DES_CPU, i);
+			}
+		}
+	}
+
+	des_destroy(&events);
+	free(parked);
+	free(cpus);
+}
+
+/*
+ * Conservative parallel engine: no timer thread and no global slot. Each
+ * CPU keeps a local clock and runs CALC streams on it without waiting
+ * for anybody, since nobody else can tell. Before a step the others can
+ * observe (dispatch, preemption, exit, memory and syscalls, or looking
+ * for work) it waits until every other device is done with the slots
+ * before its own, so the step sees what the threaded engine would. The
+ * next arrival bounds how far ahead a CPU may run (the lookahead), as a
+ * policy may preempt on it. A kill only stops a victim running ahead at
+ * its next synchronization, which is bounded by its time slice.
+ */
+struct pdes_args {
+	struct timer_id_t * timer_id;
+	struct timer_id_t * ld_event;
+	int id;
+};
+
+static void * pdes_cpu_routine(void * args) {
+	struct pdes_args * pa = (struct pdes_args *) args;
+	struct timer_id_t * timer_id = pa->timer_id;
+	struct cpu_state cs = { pa->id, 0, 0, 1, NULL };
+	enum cpu_status status;
+	uint64_t clock = 0, horizon;
+
+	bind_clock(timer_id);
+	for (;;) {
+		/* Stay behind the next admission: the loader admits once
+		 * every CPU is done with slot [horizon], so a CPU past it
+		 * waits for the arrivals, even in the middle of CALC */
+		horizon = clock_of(pa->ld_event);
+		if (cs.proc == NULL || cs.time_left == 0 ||
+				!cpu_only(cs.proc) || clock >= horizon) {
+			clock_sync(timer_id, clock);
+			horizon = clock_of(pa->ld_event);
 		}
-		
+		cs.max_ticks = step_ticks(clock, horizon);
+
+		status = cpu_step(&cs);
+		if (status == CPU_STOPPED)
+			break;
+		clock += status == CPU_BUSY ? cs.ticks : 1;
+		clock_advance(timer_id, clock);
+	}
+	detach_event(timer_id);
+	pthread_exit(NULL);
+}
+
+static void * pdes_ld_routine(void * args) {
 #ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
-		init_mm(proc->mm, proc);
-		proc->mram = mram;
-		proc->mswp = mswp;
-		proc->active_mswp = active_mswp;
+	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
+#else
+	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
-		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
-		next_slot(timer_id);
+	struct ld_entry * e;
+	uint64_t clock = 0;
+
+	bind_clock(timer_id);
+	printf("ld_routine\n");
+	e = ldpool_peek();
+	while (e != NULL) {
+		if (clock < e->start_time)
+			clock = e->start_time;
+		/* Admit once every CPU is done with the slot, so the
+		 * processes run from the next one */
+		clock_advance(timer_id, clock);
+		clock_sync(timer_id, clock + 1);
+		e = admit_due(e, clock, args);
+		clock_advance(timer_id, ++clock);
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
 	done = 1;
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+static void pdes_run(void * ld_args) {
+	pthread_t * cpu = malloc(num_cpus * sizeof(pthread_t));
+	struct pdes_args * args = malloc(num_cpus * sizeof(struct pdes_args));
+	struct timer_id_t * ld_event;
+	pthread_t ld;
+	int i;
+
+	for (i = 0; i < num_cpus; i++)
+		args[i].timer_id = attach_event();
+	ld_event = attach_event();
+	for (i = 0; i < num_cpus; i++) {
+		args[i].ld_event = ld_event;
+		args[i].id = i;
+	}
+#ifdef MM_PAGING
+	((struct mmpaging_ld_args *)ld_args)->timer_id = ld_event;
+#else
+	ld_args = ld_event;
+#endif
+
+	pthread_create(&ld, NULL, pdes_ld_routine, ld_args);
+	for (i = 0; i < num_cpus; i++)
+		pthread_create(&cpu[i], NULL, pdes_cpu_routine, &args[i]);
+	for (i = 0; i < num_cpus; i++)
+		pthread_join(cpu[i], NULL);
+	pthread_join(ld, NULL);
+
+	stop_timer();
+	free(args);
+	free(cpu);
+}
+
+/* Resolve [name] of the config, relative to [dir] unless absolute, into
+ * [*buf] of [*cap] bytes, grown as needed */
+static char * input_path(const char * dir, const char * name, size_t len,
+		char ** buf, size_t * cap) {
+	size_t dlen = name[0] == '/' ? 0 : strlen(dir);
+
+	if (*cap < dlen + len + 1) {
+		*cap = 2 * (dlen + len + 1);
+		*buf = realloc(*buf, *cap);
+	}
+	memcpy(*buf, dir, dlen);
+	memcpy(*buf + dlen, name, len);
+	(*buf)[dlen + len] = '\0';
+	return *buf;
+}
+
+/* Read the next process entry of the config into [e]:
+ * [start time] [program] [priority]. Called by the parser pool as the
+ * loader moves on, so the config is never held in memory */
+static int read_entry(struct ld_entry * e) {
+	char * p, * end;
+	size_t len;
+
+	while (config.nr_read < num_processes && (config.pending ||
+			getline(&config.line, &config.line_cap, config.file) > 0)) {
+		config.pending = 0;
+		p = config.line;
+		e->start_time = strtoul(p, &end, 10);
+		if (end == p) {
+			/* Blank or malformed line */
+			p += strspn(p, " \t\r\n");
+			if (*p != '\0')
+				printf("Invalid process entry: %s", config.line);
+			continue;
+		}
+		p = end + strspn(end, " \t");
+		len = strcspn(p, " \t\r\n");
+		if (len == 0) {
+			printf("Invalid process entry: %s", config.line);
+			continue;
+		}
+		input_path("input/proc/", p, len, &e->path, &e->path_cap);
+		e->prio = strtoul(p + len, NULL, 10);
+		config.nr_read++;
+		return 0;
+	}
+	return -1;
+}
+
 static void read_config(const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
 		printf("Cannot find configure file at %s\n", path);
 		exit(1);
 	}
-	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
+	config.file = file;
+	config.line = NULL;
+	config.line_cap = 0;
+	config.nr_read = 0;
+	config.pending = 0;
+	/* First line: [time slice] [N = Number of CPU] [M = Number of Processes]
+	 * and an optional scheduling policy (fifo, rr, mlq, mlfq, sri, cfs),
+	 * MLQ by default */
+	char policy[32];
+	if (getline(&config.line, &config.line_cap, file) <= 0) {
+		printf("Empty configure file %s\n", path);
+		exit(1);
+	}
+	policy[0] = '\0';
+	sscanf(config.line, "%d %d %d %31s", &time_slot, &num_cpus,
+		&num_processes, policy);
+	if (policy[0] != '\0' && sched_set_policy(policy) != 0) {
+		printf("Unknown scheduling policy '%s'\n", policy);
+		exit(1);
+	}
 	num_act_cpus = num_cpus;
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
 #ifdef MM_PAGING
 	int sit;
 #ifdef MM_FIXED_MEMSZ
@@ -188,58 +539,157 @@ static void read_config(const char * path) {
 	 * Format: (size=0 result non-used memswap, must have RAM and at least 1 SWAP)
 	 *        MEM_RAM_SZ MEM_SWP0_SZ MEM_SWP1_SZ MEM_SWP2_SZ MEM_SWP3_SZ
 	*/
-	fscanf(file, "%d\n", &memramsz);
+	int legacy = 1;
 	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-		fscanf(file, "%d", &(memswpsz[sit])); 
-
-       fscanf(file, "\n"); /* Final character */
+		memswpsz[sit] = 0;
+	if (getline(&config.line, &config.line_cap, file) > 0) {
+		legacy = sscanf(config.line, "%d %d %d %d %d", &memramsz,
+			&memswpsz[0], &memswpsz[1], &memswpsz[2],
+			&memswpsz[3]) < 2;
+		/* Then the line read is the first process entry */
+		config.pending = legacy;
+	}
+	if (legacy) {
+		/* A legacy config without this line */
+		memramsz    =  0x100000;
+		memswpsz[0] = 0x1000000;
+		for(sit = 1; sit < PAGING_MAX_MMSWP; sit++)
+			memswpsz[sit] = 0;
+	}
 #endif
 #endif
+	/* The process entries are read by the loader, see read_entry() */
+}
 
-#ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
-#endif
-	int i;
-	for (i = 0; i < num_processes; i++) {
-		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
-#ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
-#else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
+static void close_config(void) {
+	fclose(config.file);
+	free(config.line);
+}
+
+/* Counters of the run as a JSON object, for the bench harness */
+static int write_metrics(const char * path) {
+	FILE * out = fopen(path, "w");
+	uint64_t ticks = 0;
+	int nr_procs = stats_finished(&ticks);
+	unsigned long nr_faults = 0, tlb_hits = 0, tlb_misses = 0;
+
+	if (out == NULL)
+		return -1;
+#ifdef MM_PAGING
+	nr_faults = pg_fault_count();
+	tlb_stats(&tlb_hits, &tlb_misses);
 #endif
-		strcat(ld_processes.path[i], proc);
-	}
+	fprintf(out, "{\"processes\": %d, \"ticks\": %lu, "
+		"\"instructions\": %lu, \"page_faults\": %lu, "
+		"\"tlb_hits\": %lu, \"tlb_misses\": %lu}\n",
+		nr_procs, ticks, nr_insts, nr_faults, tlb_hits, tlb_misses);
+	return fclose(out);
+}
+
+static void usage(void) {
+	printf("Usage: os [options] [path to configure file]\n");
+	printf("  The configure file and its programs are looked up under input/\n"
+	       "  and input/proc/, unless their path is absolute\n");
+	printf("  -t, --tickless    skip time slots where every CPU is idle\n");
+	printf("  -e, --engine=E    simulation engine: threads (default), coro\n"
+	       "                    (CPUs as coroutines over a few threads), des\n"
+	       "                    or pdes (parallel discrete-event)\n");
+	printf("  -w, --workers=N   host threads of the coro engine, one per\n"
+	       "                    online core by default\n");
+	printf("  -b, --batch       run CALC streams up to a whole time slice per\n"
+	       "                    synchronization\n");
+	printf("  -r, --reclaim     give the frames of a process back to RAM and\n"
+	       "                    swap when it exits, they are never reused by\n"
+	       "                    default\n");
+	printf("  -m, --metrics=F   write the counters of the run to F as JSON\n");
+	printf("  -T, --tlb=N       entries of the TLB of each CPU, a power of two,\n"
+	       "                    64 by default, 0 disables it\n");
 }
 
+enum engine {
+	ENGINE_THREADS,	/* one host thread per CPU, loader and timer */
+	ENGINE_CORO,	/* CPU coroutines over a pool of host threads */
+	ENGINE_DES,	/* single-threaded discrete-event loop */
+	ENGINE_PDES,	/* conservative parallel discrete-event */
+};
+
 int main(int argc, char * argv[]) {
+	static const struct option options[] = {
+		{ "tickless", no_argument, NULL, 't' },
+		{ "engine", required_argument, NULL, 'e' },
+		{ "batch", no_argument, NULL, 'b' },
+		{ "workers", required_argument, NULL, 'w' },
+		{ "reclaim", no_argument, NULL, 'r' },
+		{ "metrics", required_argument, NULL, 'm' },
+		{ "tlb", required_argument, NULL, 'T' },
+		{ NULL, 0, NULL, 0 }
+	};
+	enum engine engine = ENGINE_THREADS;
+	int nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	const char * metrics = NULL;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "te:bw:rm:T:", options, NULL)) != -1) {
+		switch (opt) {
+		case 't':
+			set_tickless(1);
+			break;
+		case 'b':
+			batch = 1;
+			break;
+		case 'r':
+			reclaim = 1;
+			break;
+		case 'm':
+			metrics = optarg;
+			break;
+		case 'T':
+			tlb_entries = atoi(optarg);
+			if (tlb_entries < 0 ||
+					(tlb_entries & (tlb_entries - 1)) != 0) {
+				usage();
+				return 1;
+			}
+			break;
+		case 'w':
+			nr_workers = atoi(optarg);
+			if (nr_workers <= 0) {
+				usage();
+				return 1;
+			}
+			break;
+		case 'e':
+			if (strcmp(optarg, "threads") == 0) {
+				engine = ENGINE_THREADS;
+			} else if (strcmp(optarg, "coro") == 0) {
+				engine = ENGINE_CORO;
+			} else if (strcmp(optarg, "des") == 0) {
+				engine = ENGINE_DES;
+			} else if (strcmp(optarg, "pdes") == 0) {
+				engine = ENGINE_PDES;
+			} else {
+				usage();
+				return 1;
+			}
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
 	/* Read config */
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
+	if (optind != argc - 1) {
+		usage();
 		return 1;
 	}
-	char path[100];
-	path[0] = '\0';
-	strcat(path, "input/");
-	strcat(path, argv[1]);
-	read_config(path);
-
-	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
-	struct cpu_args * args =
-		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
-	pthread_t ld;
-	
-	/* Init timer */
+	char * path = NULL;
+	size_t path_cap = 0;
+	read_config(input_path("input/", argv[optind], strlen(argv[optind]),
+		&path, &path_cap));
+	free(path);
+
+	void * ld_args = NULL;
 	int i;
-	for (i = 0; i < num_cpus; i++) {
-		args[i].timer_id = attach_event();
-		args[i].id = i;
-	}
-	struct timer_id_t * ld_event = attach_event();
-	start_timer();
 
 #ifdef MM_PAGING
 	/* Init all MEMPHY include 1 MEMRAM and n of MEMSWP */
@@ -259,43 +709,95 @@ int main(int argc, char * argv[]) {
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
 
-	mm_ld_args->timer_id = ld_event;
+	mm_ld_args->timer_id = NULL;
 	mm_ld_args->mram = (struct memphy_struct *) &mram;
 	mm_ld_args->mswp = (struct memphy_struct**) &mswp;
 	mm_ld_args->active_mswp = (struct memphy_struct *) &mswp[0];
         mm_ld_args->active_mswp_id = 0;
+	ld_args = mm_ld_args;
+	tlb_init(num_cpus, tlb_entries);
 #endif
 
 	/* Init scheduler */
-	init_scheduler();
-
-	sem_init(&sync_sem, 0, 0); 
-
-	/* Run CPU and loader */
+	stats_init(num_processes);
+	init_scheduler(num_cpus, time_slot, num_processes);
+	ldpool_start(sysconf(_SC_NPROCESSORS_ONLN), read_entry, load_proc);
+
+	if (engine == ENGINE_DES) {
+		des_routine(ld_args);
+	} else if (engine == ENGINE_PDES) {
+		pdes_run(ld_args);
+	} else {
+		pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
+		struct cpu_args * args =
+			(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
+		struct coro_pool_t * pool = NULL;
+		pthread_t ld;
+
+		/* Init timer */
+		if (engine == ENGINE_CORO)
+			pool = coro_pool_create(nr_workers < num_cpus ?
+				nr_workers : num_cpus);
+		for (i = 0; i < num_cpus; i++) {
+			args[i].id = i;
+			if (pool != NULL)
+				args[i].timer_id = coro_spawn(pool,
+					cpu_routine, &args[i]);
+			else
+				args[i].timer_id = attach_event();
+		}
+		struct timer_id_t * ld_event = attach_event();
 #ifdef MM_PAGING
-	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
+		mm_ld_args->timer_id = ld_event;
 #else
-	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
+		ld_args = ld_event;
 #endif
-	for (i = 0; i < num_cpus; i++) {
-		pthread_create(&cpu[i], NULL,
-			cpu_routine, (void*)&args[i]);
-	}
+		start_timer();
+
+		sem_init(&sync_sem, 0, 0); 
+
+		/* Run CPU and loader */
+		pthread_create(&ld, NULL, ld_routine, ld_args);
+		if (pool != NULL) {
+			coro_pool_run(pool);
+		} else {
+			for (i = 0; i < num_cpus; i++) {
+				pthread_create(&cpu[i], NULL,
+					cpu_routine, (void*)&args[i]);
+			}
+		}
 
-	/* Wait for CPU and loader finishing */
-	for (i = 0; i < num_cpus; i++) {
-		pthread_join(cpu[i], NULL);
+		/* Wait for CPU and loader finishing */
+		for (i = 0; pool == NULL && i < num_cpus; i++) {
+			pthread_join(cpu[i], NULL);
+		}
+		pthread_join(ld, NULL);
+
+		/* Stop timer */
+		stop_timer();
+
+		sem_destroy(&sync_sem);
+		if (pool != NULL)
+			coro_pool_destroy(pool);
+		free(args);
+		free(cpu);
 	}
-	pthread_join(ld, NULL);
 
-	/* Stop timer */
-	stop_timer();
+	ldpool_stop();
+	close_config();
+	finish_scheduler();
+	loader_destroy();
 
-	sem_destroy(&sync_sem);
+#ifdef SCHED_STATS
+	stats_report(stdout);
+#endif
+	if (metrics != NULL && write_metrics(metrics) < 0)
+		printf("Cannot write metrics at '%s'\n", metrics);
+	stats_destroy();
+#ifdef MM_PAGING
+	tlb_destroy();
+#endif
 
 	return 0;
 
 }
-
-
-
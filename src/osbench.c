@@ -0,0 +1,232 @@
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+/*
+ * Benchmark harness. It runs the simulator over a list of configs with
+ * its output thrown away, and reports for each run the wall time, the
+ * rates of simulated ticks, instructions and page faults, the TLB hits
+ * and misses, and the peak RSS, as one JSON document. The counters come
+ * from "os --metrics".
+ */
+
+#define MAX_OS_ARGS	32
+
+struct run_metrics {
+	long processes;
+	unsigned long ticks;
+	unsigned long instructions;
+	unsigned long page_faults;
+	unsigned long tlb_hits;
+	unsigned long tlb_misses;
+};
+
+static const char * os_path = "./os";
+static char * os_args[MAX_OS_ARGS];
+static int nr_os_args;
+
+/* Counter [key] of the metrics JSON [buf], 0 if missing */
+static unsigned long metric(const char * buf, const char * key) {
+	char pattern[64];
+	const char * p;
+
+	snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+	if ((p = strstr(buf, pattern)) == NULL)
+		return 0;
+	return strtoul(p + strlen(pattern), NULL, 10);
+}
+
+static int read_metrics(const char * path, struct run_metrics * m) {
+	char buf[512];
+	size_t len;
+	FILE * file = fopen(path, "r");
+
+	memset(m, 0, sizeof(*m));
+	if (file == NULL)
+		return -1;
+	len = fread(buf, 1, sizeof(buf) - 1, file);
+	buf[len] = '\0';
+	fclose(file);
+	m->processes = metric(buf, "processes");
+	m->ticks = metric(buf, "ticks");
+	m->instructions = metric(buf, "instructions");
+	m->page_faults = metric(buf, "page_faults");
+	m->tlb_hits = metric(buf, "tlb_hits");
+	m->tlb_misses = metric(buf, "tlb_misses");
+	return 0;
+}
+
+/* Run the simulator over [config], fill the wall time in seconds and the
+ * peak RSS in KiB. Return its exit status, -1 if it did not exit */
+static int run_os(const char * config, const char * metrics_path,
+		double * wall, long * peak_rss) {
+	char * argv[MAX_OS_ARGS + 5];
+	struct timespec start, end;
+	struct rusage ru;
+	int argc = 0, i, status, fd;
+	pid_t pid;
+
+	argv[argc++] = (char *) os_path;
+	for (i = 0; i < nr_os_args; i++)
+		argv[argc++] = os_args[i];
+	argv[argc++] = "--metrics";
+	argv[argc++] = (char *) metrics_path;
+	argv[argc++] = (char *) config;
+	argv[argc] = NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if ((pid = fork()) == 0) {
+		fd = open("/dev/null", O_WRONLY);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		execv(os_path, argv);
+		_exit(127);
+	}
+	if (pid < 0 || wait4(pid, &status, 0, &ru) < 0)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	*wall = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	*peak_rss = ru.ru_maxrss;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void print_json_string(FILE * out, const char * s) {
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fputc('\\', out);
+		fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+static double rate(unsigned long count, double wall) {
+	return wall > 0 ? count / wall : 0;
+}
+
+static void usage(void) {
+	printf("Usage: osbench [options] [configure file]...\n");
+	printf("  -o, --output=F    write the JSON report to F, stdout by default\n");
+	printf("  -a, --args=ARGS   options passed to every os run, separated by\n"
+	       "                    spaces, such as \"-e des -r\"\n");
+	printf("  -x, --os=PATH     simulator to run, ./os by default\n");
+	printf("  -n, --repeat=N    runs of each config, 1 by default\n");
+}
+
+int main(int argc, char * argv[]) {
+	static const struct option options[] = {
+		{ "output", required_argument, NULL, 'o' },
+		{ "args", required_argument, NULL, 'a' },
+		{ "os", required_argument, NULL, 'x' },
+		{ "repeat", required_argument, NULL, 'n' },
+		{ NULL, 0, NULL, 0 }
+	};
+	char metrics_path[] = "/tmp/osbench-XXXXXX";
+	char config[PATH_MAX];
+	const char * args = "";
+	FILE * out = stdout;
+	int repeat = 1, opt, i, r, fd, first = 1, failed = 0;
+	char * tok, * buf;
+
+	while ((opt = getopt_long(argc, argv, "o:a:x:n:", options, NULL)) != -1) {
+		switch (opt) {
+		case 'o':
+			if ((out = fopen(optarg, "w")) == NULL) {
+				fprintf(stderr, "Cannot write report at '%s'\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'a':
+			args = optarg;
+			break;
+		case 'x':
+			os_path = optarg;
+			break;
+		case 'n':
+			repeat = atoi(optarg);
+			if (repeat <= 0) {
+				usage();
+				return 1;
+			}
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (optind == argc) {
+		usage();
+		return 1;
+	}
+	buf = strdup(args);
+	for (tok = strtok(buf, " "); tok != NULL; tok = strtok(NULL, " ")) {
+		if (nr_os_args == MAX_OS_ARGS) {
+			usage();
+			return 1;
+		}
+		os_args[nr_os_args++] = tok;
+	}
+	if ((fd = mkstemp(metrics_path)) < 0) {
+		fprintf(stderr, "Cannot create '%s'\n", metrics_path);
+		return 1;
+	}
+	close(fd);
+
+	fprintf(out, "{\n  \"os_args\": ");
+	print_json_string(out, args);
+	fprintf(out, ",\n  \"runs\": [");
+	for (i = optind; i < argc; i++) {
+		/* os looks relative names up under input/ */
+		if (realpath(argv[i], config) == NULL) {
+			fprintf(stderr, "Cannot find configure file '%s'\n",
+				argv[i]);
+			failed = 1;
+			continue;
+		}
+		for (r = 0; r < repeat; r++) {
+			struct run_metrics m;
+			double wall = 0;
+			long peak_rss = 0;
+			int status;
+
+			unlink(metrics_path);
+			status = run_os(config, metrics_path, &wall, &peak_rss);
+			if (status != 0 || read_metrics(metrics_path, &m) < 0) {
+				memset(&m, 0, sizeof(m));
+				failed = 1;
+			}
+			fprintf(out, "%s\n    {\"config\": ", first ? "" : ",");
+			first = 0;
+			print_json_string(out, argv[i]);
+			fprintf(out, ", \"status\": %d, \"wall_s\": %.6f, "
+				"\"processes\": %ld, \"ticks\": %lu, "
+				"\"instructions\": %lu, \"page_faults\": %lu, "
+				"\"ticks_per_s\": %.1f, \"instructions_per_s\": %.1f, "
+				"\"page_faults_per_s\": %.1f, \"tlb_hits\": %lu, "
+				"\"tlb_misses\": %lu, \"peak_rss_kb\": %ld}",
+				status, wall, m.processes, m.ticks, m.instructions,
+				m.page_faults, rate(m.ticks, wall),
+				rate(m.instructions, wall),
+				rate(m.page_faults, wall), m.tlb_hits,
+				m.tlb_misses, peak_rss);
+			fflush(out);
+		}
+	}
+	fprintf(out, "\n  ]\n}\n");
+	unlink(metrics_path);
+	free(buf);
+	if (out != stdout)
+		fclose(out);
+	return failed;
+}
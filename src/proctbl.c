@@ -0,0 +1,112 @@
+
+#include "proctbl.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROCTBL_INIT_SZ 64
+
+struct proc_entry {
+	struct pcb_t * proc;
+	int live_idx;	// Index of the PCB in live[], -1 if not live
+};
+
+static struct proc_entry * entries;	// Indexed by PID
+static uint32_t nr_entries;
+static struct pcb_t ** live;		// Packed live PCBs
+static int nr_live;
+static uint32_t live_cap;
+static pthread_mutex_t tbl_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Grow [arr] of [*cap] elements of [sz] bytes to hold [need] elements */
+static void * grow(void * arr, size_t sz, uint32_t * cap, uint32_t need) {
+	uint32_t old = *cap;
+	uint32_t ncap = old ? old : PROCTBL_INIT_SZ;
+
+	while (ncap < need)
+		ncap *= 2;
+	if (ncap == old)
+		return arr;
+	arr = realloc(arr, ncap * sz);
+	memset((char *)arr + old * sz, 0, (ncap - old) * sz);
+	*cap = ncap;
+	return arr;
+}
+
+static void __proc_unregister(uint32_t pid) {
+	struct proc_entry * e;
+	int idx;
+
+	if (pid >= nr_entries || entries[pid].proc == NULL)
+		return;
+	e = &entries[pid];
+
+	/* Fill the hole with the last live PCB */
+	idx = e->live_idx;
+	if (idx != --nr_live) {
+		live[idx] = live[nr_live];
+		entries[live[idx]->pid].live_idx = idx;
+	}
+
+	e->proc = NULL;
+	e->live_idx = -1;
+}
+
+void proctbl_init(void) {
+	pthread_mutex_lock(&tbl_lock);
+	nr_entries = 0;
+	entries = NULL;
+	nr_live = live_cap = 0;
+	live = NULL;
+	pthread_mutex_unlock(&tbl_lock);
+}
+
+void proctbl_destroy(void) {
+	pthread_mutex_lock(&tbl_lock);
+	free(entries);
+	free(live);
+	entries = NULL;
+	live = NULL;
+	nr_entries = 0;
+	nr_live = live_cap = 0;
+	pthread_mutex_unlock(&tbl_lock);
+}
+
+int proc_register(struct pcb_t * proc) {
+	pthread_mutex_lock(&tbl_lock);
+	entries = grow(entries, sizeof(*entries), &nr_entries, proc->pid + 1);
+	if (entries[proc->pid].proc != NULL) {
+		pthread_mutex_unlock(&tbl_lock);
+		return -1; // PID in use
+	}
+	live = grow(live, sizeof(*live), &live_cap, nr_live + 1);
+
+	entries[proc->pid].proc = proc;
+	entries[proc->pid].live_idx = nr_live;
+	live[nr_live++] = proc;
+	pthread_mutex_unlock(&tbl_lock);
+	return 0;
+}
+
+void proc_unregister(struct pcb_t * proc) {
+	pthread_mutex_lock(&tbl_lock);
+	if (proc->pid < nr_entries && entries[proc->pid].proc == proc)
+		__proc_unregister(proc->pid);
+	pthread_mutex_unlock(&tbl_lock);
+}
+
+int proctbl_for_each(int (*fn)(struct pcb_t * proc, void * arg), void * arg) {
+	int i, dropped = 0;
+
+	pthread_mutex_lock(&tbl_lock);
+	/* Walk backward so that dropping live[i] only moves visited PCBs */
+	for (i = nr_live - 1; i >= 0; i--) {
+		uint32_t pid = live[i]->pid;
+		if (fn(live[i], arg)) {
+			__proc_unregister(pid);
+			dropped++;
+		}
+	}
+	pthread_mutex_unlock(&tbl_lock);
+	return dropped;
+}
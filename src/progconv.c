@@ -0,0 +1,22 @@
+
+#include "loader.h"
+#include <stdio.h>
+
+/* Convert text programs of input/proc/ to the binary format load() maps,
+ * see loader.h */
+int main(int argc, char * argv[]) {
+	struct code_seg_t * code;
+	uint32_t priority;
+
+	if (argc != 3) {
+		printf("Usage: progconv [text program] [binary program]\n");
+		return 1;
+	}
+	code = load_code(argv[1], &priority);
+	if (save_code(argv[2], code, priority) < 0) {
+		printf("Cannot write binary program at '%s'\n", argv[2]);
+		return 1;
+	}
+	put_code(code);
+	return 0;
+}
@@ -9,39 +9,32 @@ int empty(struct queue_t * q) {
 
 void enqueue(struct queue_t * q, struct pcb_t * proc) {
         // Enqueue a new PCB into ready queue [q]
-        
-        if (q != NULL && proc != NULL && q->size < MAX_QUEUE_SIZE){
-                // Avoid duplicate enqueues based on PID
-                for(int i = 0; i < q->size; i++){
-                        if(proc->pid == q->proc[i]->pid){
-                                // printf("------------ Enqueue duplicate process %d ------------\n", proc->pid);
-                                return; // Dup detected => skip enqueue
-                        }
-                }
-                // Insert proc at tail of queue
-                q->proc[q->size] = proc;
-                q->size++;
-        }
+
+        if (q == NULL || proc == NULL)
+                return;
+        // Avoid duplicate enqueues, a PCB has a single link
+        if (proc->queue != NULL)
+                return;
+
+        // Insert proc at tail of queue
+        proc->queue = q;
+        proc->q_next = NULL;
+        proc->q_prev = q->tail;
+        if (q->tail != NULL)
+                q->tail->q_next = proc;
+        else
+                q->head = proc;
+        q->tail = proc;
+        q->size++;
 }
 
 struct pcb_t * dequeue(struct queue_t * q) {
-        // Dequeue the PCB with highest priority (lowest prio value) from [q]
+        // Dequeue the PCB at head of [q]
 
         struct pcb_t * process = NULL;
-        if(q != NULL){
-                int idx = 0;
-                unsigned long prio = MAX_PRIO;
-                // Find the proc with min prio (highest priority)
-                for(int i = 0; i < q->size; i++){
-                        if(process == NULL || prio > q->proc[i]->prio){
-                                process = q->proc[i];
-                                prio = q->proc[i]->prio;
-                                idx = i;
-                        }            
-                }
-                if (process != NULL){
-                        peek_at_index(q, idx);
-                }    
+        if (!empty(q)) {
+                process = q->head;
+                queue_remove(q, process);
         }
 	return process;
 }
@@ -49,28 +42,35 @@ struct pcb_t * dequeue(struct queue_t * q) {
 void peek_at_id(struct queue_t *q, uint32_t pid){
         // Remove PCB with matching PID from queue [q]
 
-        if(q != NULL && !empty(q)){
-                for(int i = 0; i < q->size; i++){
-                        if(q->proc[i]->pid == pid){
-                                // Found => remove at index i
-                                peek_at_index(q, i);
-                                return;   
-                        }
+        struct pcb_t * proc;
+        if (q == NULL)
+                return;
+        for (proc = q->head; proc != NULL; proc = proc->q_next) {
+                if (proc->pid == pid) {
+                        // Found => unlink it
+                        queue_remove(q, proc);
+                        return;
                 }
         }
 }
 
-void peek_at_index(struct queue_t *q, int index){
-        // Remove PCB at given idx in queue [q]
+void queue_remove(struct queue_t *q, struct pcb_t *proc){
+        // Unlink PCB [proc] from queue [q]
 
-        if(q != NULL && !empty(q)){
-                // Shift procs left from idx
-                for(int j = index; j < q->size - 1; j++){
-                        q->proc[j] = q->proc[j + 1];
-                }
+        if (q == NULL || proc == NULL || proc->queue != q)
+                return;
 
-                // Clear last slot & dec q size
-                q->proc[q->size - 1] = NULL;
-                q->size--;
-        }
+        if (proc->q_prev != NULL)
+                proc->q_prev->q_next = proc->q_next;
+        else
+                q->head = proc->q_next;
+        if (proc->q_next != NULL)
+                proc->q_next->q_prev = proc->q_prev;
+        else
+                q->tail = proc->q_prev;
+
+        proc->q_prev = proc->q_next = NULL;
+        proc->queue = NULL;
+        q->size--;
 }
+
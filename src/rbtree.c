@@ -0,0 +1,214 @@
+#include "rbtree.h"
+
+/* Red-black tree with NULL leaves, which count as black (CLRS ch. 13) */
+
+static int is_red(struct rb_node * node) {
+	return node != NULL && node->rb_color == RB_RED;
+}
+
+/* Put [new] where [old] hangs from [parent] */
+static void replace_child(struct rb_root * root, struct rb_node * parent,
+		struct rb_node * old, struct rb_node * new) {
+	if (parent == NULL)
+		root->rb_node = new;
+	else if (parent->rb_left == old)
+		parent->rb_left = new;
+	else
+		parent->rb_right = new;
+}
+
+static void rotate_left(struct rb_root * root, struct rb_node * x) {
+	struct rb_node * y = x->rb_right;
+
+	x->rb_right = y->rb_left;
+	if (y->rb_left != NULL)
+		y->rb_left->rb_parent = x;
+	y->rb_parent = x->rb_parent;
+	replace_child(root, x->rb_parent, x, y);
+	y->rb_left = x;
+	x->rb_parent = y;
+}
+
+static void rotate_right(struct rb_root * root, struct rb_node * x) {
+	struct rb_node * y = x->rb_left;
+
+	x->rb_left = y->rb_right;
+	if (y->rb_right != NULL)
+		y->rb_right->rb_parent = x;
+	y->rb_parent = x->rb_parent;
+	replace_child(root, x->rb_parent, x, y);
+	y->rb_right = x;
+	x->rb_parent = y;
+}
+
+void rb_insert_color(struct rb_node * node, struct rb_root * root) {
+	struct rb_node * parent, * gparent, * uncle;
+
+	while (is_red(parent = node->rb_parent)) {
+		// A red parent is never the root, so gparent exists
+		gparent = parent->rb_parent;
+		if (parent == gparent->rb_left) {
+			uncle = gparent->rb_right;
+			if (is_red(uncle)) {
+				// Recolor and move the violation up
+				parent->rb_color = uncle->rb_color = RB_BLACK;
+				gparent->rb_color = RB_RED;
+				node = gparent;
+				continue;
+			}
+			if (node == parent->rb_right) {
+				rotate_left(root, parent);
+				node = parent;
+				parent = node->rb_parent;
+			}
+			parent->rb_color = RB_BLACK;
+			gparent->rb_color = RB_RED;
+			rotate_right(root, gparent);
+		} else {
+			uncle = gparent->rb_left;
+			if (is_red(uncle)) {
+				parent->rb_color = uncle->rb_color = RB_BLACK;
+				gparent->rb_color = RB_RED;
+				node = gparent;
+				continue;
+			}
+			if (node == parent->rb_left) {
+				rotate_right(root, parent);
+				node = parent;
+				parent = node->rb_parent;
+			}
+			parent->rb_color = RB_BLACK;
+			gparent->rb_color = RB_RED;
+			rotate_left(root, gparent);
+		}
+	}
+	root->rb_node->rb_color = RB_BLACK;
+}
+
+/* Restore the black height after removing a black node, [node] (maybe
+ * NULL) being the child that took its place under [parent] */
+static void erase_color(struct rb_node * node, struct rb_node * parent,
+		struct rb_root * root) {
+	struct rb_node * sibling;
+
+	while (node != root->rb_node && !is_red(node)) {
+		if (node == parent->rb_left) {
+			sibling = parent->rb_right;
+			if (is_red(sibling)) {
+				sibling->rb_color = RB_BLACK;
+				parent->rb_color = RB_RED;
+				rotate_left(root, parent);
+				sibling = parent->rb_right;
+			}
+			if (!is_red(sibling->rb_left) && !is_red(sibling->rb_right)) {
+				sibling->rb_color = RB_RED;
+				node = parent;
+				parent = node->rb_parent;
+				continue;
+			}
+			if (!is_red(sibling->rb_right)) {
+				sibling->rb_left->rb_color = RB_BLACK;
+				sibling->rb_color = RB_RED;
+				rotate_right(root, sibling);
+				sibling = parent->rb_right;
+			}
+			sibling->rb_color = parent->rb_color;
+			parent->rb_color = RB_BLACK;
+			sibling->rb_right->rb_color = RB_BLACK;
+			rotate_left(root, parent);
+		} else {
+			sibling = parent->rb_left;
+			if (is_red(sibling)) {
+				sibling->rb_color = RB_BLACK;
+				parent->rb_color = RB_RED;
+				rotate_right(root, parent);
+				sibling = parent->rb_left;
+			}
+			if (!is_red(sibling->rb_left) && !is_red(sibling->rb_right)) {
+				sibling->rb_color = RB_RED;
+				node = parent;
+				parent = node->rb_parent;
+				continue;
+			}
+			if (!is_red(sibling->rb_left)) {
+				sibling->rb_right->rb_color = RB_BLACK;
+				sibling->rb_color = RB_RED;
+				rotate_left(root, sibling);
+				sibling = parent->rb_left;
+			}
+			sibling->rb_color = parent->rb_color;
+			parent->rb_color = RB_BLACK;
+			sibling->rb_left->rb_color = RB_BLACK;
+			rotate_right(root, parent);
+		}
+		node = root->rb_node;
+		break;
+	}
+	if (node != NULL)
+		node->rb_color = RB_BLACK;
+}
+
+void rb_erase(struct rb_node * node, struct rb_root * root) {
+	struct rb_node * child, * parent, * succ;
+	int color;
+
+	if (node->rb_left == NULL || node->rb_right == NULL) {
+		// At most one child => splice node out
+		child = node->rb_left != NULL ? node->rb_left : node->rb_right;
+		parent = node->rb_parent;
+		color = node->rb_color;
+		if (child != NULL)
+			child->rb_parent = parent;
+		replace_child(root, parent, node, child);
+	} else {
+		// Two children => the successor takes the place of node
+		succ = node->rb_right;
+		while (succ->rb_left != NULL)
+			succ = succ->rb_left;
+		child = succ->rb_right;
+		color = succ->rb_color;
+		if (succ->rb_parent == node) {
+			parent = succ;
+		} else {
+			parent = succ->rb_parent;
+			parent->rb_left = child;
+			if (child != NULL)
+				child->rb_parent = parent;
+			succ->rb_right = node->rb_right;
+			node->rb_right->rb_parent = succ;
+		}
+		succ->rb_left = node->rb_left;
+		node->rb_left->rb_parent = succ;
+		succ->rb_parent = node->rb_parent;
+		succ->rb_color = node->rb_color;
+		replace_child(root, node->rb_parent, node, succ);
+	}
+
+	if (color == RB_BLACK)
+		erase_color(child, parent, root);
+}
+
+struct rb_node * rb_first(const struct rb_root * root) {
+	struct rb_node * node = root->rb_node;
+
+	if (node == NULL)
+		return NULL;
+	while (node->rb_left != NULL)
+		node = node->rb_left;
+	return node;
+}
+
+struct rb_node * rb_next(const struct rb_node * node) {
+	struct rb_node * parent;
+
+	if (node->rb_right != NULL) {
+		node = node->rb_right;
+		while (node->rb_left != NULL)
+			node = node->rb_left;
+		return (struct rb_node *) node;
+	}
+	// Climb until we come up from a left subtree
+	while ((parent = node->rb_parent) != NULL && node == parent->rb_right)
+		node = parent;
+	return parent;
+}
@@ -1,144 +1,237 @@
-
 #include "queue.h"
 #include "sched.h"
+#include "sched_class.h"
+#include "proctbl.h"
+#include "stats.h"
+#include "timer.h"
 #include <pthread.h>
 
 #include <stdlib.h>
 #include <stdio.h>
-static struct queue_t ready_queue;
-static struct queue_t run_queue;
-static pthread_mutex_t queue_lock;
-
-static struct queue_t running_list;
-#ifdef MLQ_SCHED
-static struct queue_t mlq_ready_queue[MAX_PRIO];
-static int slot[MAX_PRIO];
-#endif
+#include <string.h>
 
-int queue_empty(void) {
-#ifdef MLQ_SCHED
-	unsigned long prio;
-	for (prio = 0; prio < MAX_PRIO; prio++)
-		if(!empty(&mlq_ready_queue[prio])) 
-			return -1;
-#endif
-	return (empty(&ready_queue) && empty(&run_queue));
-}
-
-void init_scheduler(void) {
-#ifdef MLQ_SCHED
-    int i ;
-
-	for (i = 0; i < MAX_PRIO; i ++) {
-		mlq_ready_queue[i].size = 0;
-		slot[i] = MAX_PRIO - i; 
-	}
-#endif
-	ready_queue.size = 0;
-	run_queue.size = 0;
-	pthread_mutex_init(&queue_lock, NULL);
-}
-
-#ifdef MLQ_SCHED
-/* 
- *  Stateful design for routine calling
- *  based on the priority and our MLQ policy
- *  We implement stateful here using transition technique
- *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
+/*
+ * Policy-agnostic dispatch core. Each simulated CPU dispatches from its
+ * own run queue, so CPUs only meet on the same queue when one of them
+ * steals work or the loader places a new process. How a run queue orders
+ * its ready processes is up to the selected sched_class.
  */
-struct pcb_t * get_mlq_proc(void) {
-	struct pcb_t * proc = NULL;
 
-	pthread_mutex_lock(&queue_lock); // Lock rq for safe concurrent access
+static const struct sched_class * sched_classes[] = {
+	&fifo_sched_class,
+	&rr_sched_class,
+	&mlq_sched_class,
+	&mlfq_sched_class,
+	&sri_sched_class,
+	&cfs_sched_class,
+};
 
-	// Traverse MLQ from high prio => low
-	for(unsigned long prio = 0; prio < MAX_PRIO; prio++){
-		if(!empty(&mlq_ready_queue[prio]) && slot[prio] > 0){
-			proc = dequeue(&mlq_ready_queue[prio]); // Pick proc from rq[prio]
-			slot[prio]--;
-			break;
-		}
-	}
+static const struct sched_class * sched_class = &mlq_sched_class;
 
-	// If lowest prio lvl exhausted => reset slot
-	if(slot[MAX_PRIO - 1] == 0 && empty(&mlq_ready_queue[MAX_PRIO - 1])){
-		for (int i = 0; i < MAX_PRIO; i++) {
-			slot[i] = MAX_PRIO - i; 
+static struct runqueue_t * runqueues;
+static int nr_rqs;
+
+int sched_time_slot;
+int sched_max_procs;
+
+int sched_set_policy(const char * name) {
+	unsigned int i;
+
+	for (i = 0; i < sizeof(sched_classes) / sizeof(sched_classes[0]); i++) {
+		if (strcmp(sched_classes[i]->name, name) == 0) {
+			sched_class = sched_classes[i];
+			return 0;
 		}
 	}
-	// Move selected proc to running list
-	enqueue(&running_list, proc);
+	return -1;
+}
 
-	// Unlock ready queue
-	pthread_mutex_unlock(&queue_lock);
-	return proc;	
+const char * sched_policy(void) {
+	return sched_class->name;
 }
 
-void put_mlq_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);
+static void init_rq(struct runqueue_t * rq, int cpu) {
+	memset(rq, 0, sizeof(*rq));
+	pthread_mutex_init(&rq->lock, NULL);
+	rq->cpu = cpu;
+	if (sched_class->init(rq) != 0) {
+		printf("Cannot set up %s run queue of CPU %d\n",
+			sched_class->name, cpu);
+		exit(1);
+	}
 }
 
-void add_mlq_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);	
+/* Approximate load of a CPU, read without its lock */
+static int rq_load(struct runqueue_t * rq) {
+	return __atomic_load_n(&rq->nr_ready, __ATOMIC_RELAXED) +
+		rq->running_list.size;
 }
 
-struct pcb_t * get_proc(void) {
-	return get_mlq_proc();
+int queue_empty(void) {
+	int cpu;
+
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+		if (__atomic_load_n(&runqueues[cpu].nr_ready, __ATOMIC_RELAXED) > 0)
+			return 0;
+	return 1;
 }
 
-void put_proc(struct pcb_t * proc) {
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = &running_list;
+void init_scheduler(int num_cpus, int time_slot, int max_procs) {
+	int cpu;
+
+	nr_rqs = num_cpus > 0 ? num_cpus : 1;
+	sched_time_slot = time_slot > 0 ? time_slot : 1;
+	/* Sizing hint, a policy queue can at worst hold every process of
+	 * the run */
+	sched_max_procs = max_procs > 0 ? max_procs : 1;
+	runqueues = malloc(nr_rqs * sizeof(struct runqueue_t));
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+		init_rq(&runqueues[cpu], cpu);
+	proctbl_init();
+}
 
-	pthread_mutex_lock(&queue_lock);
-	peek_at_id(&running_list, proc->pid);
-	pthread_mutex_unlock(&queue_lock);
+void finish_scheduler(void) {
+	int cpu;
 
-	return put_mlq_proc(proc);
+	for (cpu = 0; cpu < nr_rqs; cpu++) {
+		sched_class->exit(&runqueues[cpu]);
+		pthread_mutex_destroy(&runqueues[cpu].lock);
+	}
+	free(runqueues);
+	runqueues = NULL;
+	proctbl_destroy();
+	nr_rqs = 0;
 }
 
-void add_proc(struct pcb_t * proc) {
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = & running_list;
-
-	return add_mlq_proc(proc);
-}
-#else
-struct pcb_t * get_proc(void) {
-	struct pcb_t * proc = NULL;
-	/*TODO: get a process from [ready_queue].
-	 * Remember to use lock to protect the queue.
-	 * */
+/* Count the proc in before it becomes visible, so nr_ready never goes
+ * negative when a thief picks it right away */
+static void rq_enqueue(struct runqueue_t * rq, struct pcb_t * proc) {
+	__atomic_fetch_add(&rq->nr_ready, 1, __ATOMIC_RELEASE);
+	sched_class->enqueue(rq, proc);
+}
+
+static void rq_requeue(struct runqueue_t * rq, struct pcb_t * proc) {
+	__atomic_fetch_add(&rq->nr_ready, 1, __ATOMIC_RELEASE);
+	sched_class->requeue(rq, proc);
+}
+
+static struct pcb_t * rq_pick(struct runqueue_t * rq) {
+	struct pcb_t * proc = sched_class->pick_next(rq);
+
+	if (proc != NULL)
+		__atomic_fetch_sub(&rq->nr_ready, 1, __ATOMIC_RELEASE);
 	return proc;
 }
 
-void put_proc(struct pcb_t * proc) {
-	proc->ready_queue = &ready_queue;
-	proc->running_list = & running_list;
+/* Take one process from the most loaded other CPU */
+static struct pcb_t * steal_proc(int cpu) {
+	struct runqueue_t * busiest = NULL;
+	int i, nr, max_ready = 0;
 
-	/* TODO: put running proc to running_list */
+	for (i = 0; i < nr_rqs; i++) {
+		nr = __atomic_load_n(&runqueues[i].nr_ready, __ATOMIC_RELAXED);
+		if (i != cpu && nr > max_ready) {
+			busiest = &runqueues[i];
+			max_ready = nr;
+		}
+	}
+	if (busiest == NULL)
+		return NULL;
+
+	return rq_pick(busiest);
+}
+
+struct pcb_t * get_proc(int cpu) {
+	struct runqueue_t * rq = &runqueues[cpu];
+	struct pcb_t * proc;
+
+	proc = rq_pick(rq);
+	// Own queue is dry => help the busiest CPU
+	if (proc == NULL)
+		proc = steal_proc(cpu);
+	if (proc == NULL)
+		return NULL;
+
+	stats_dispatch(proc, current_time());
+
+	// Move selected proc to running list
+	pthread_mutex_lock(&rq->lock);
+	proc->running_list = &rq->running_list;
+	enqueue(&rq->running_list, proc);
+	pthread_mutex_unlock(&rq->lock);
+	return proc;
+}
+
+void put_proc(int cpu, struct pcb_t * proc) {
+	struct runqueue_t * rq = &runqueues[cpu];
 
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&run_queue, proc);
-	pthread_mutex_unlock(&queue_lock);
+	pthread_mutex_lock(&rq->lock);
+	queue_remove(&rq->running_list, proc);
+	pthread_mutex_unlock(&rq->lock);
+	stats_preempt(proc, current_time());
+	rq_requeue(rq, proc);
 }
 
 void add_proc(struct pcb_t * proc) {
-	proc->ready_queue = &ready_queue;
-	proc->running_list = & running_list;
+	struct runqueue_t * rq = &runqueues[0];
+	int cpu;
 
-	/* TODO: put running proc to running_list */
+	proc_register(proc);
+	stats_arrive(proc, current_time());
 
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&ready_queue, proc);
-	pthread_mutex_unlock(&queue_lock);	
+	// Place new proc on the least loaded CPU
+	for (cpu = 1; cpu < nr_rqs; cpu++)
+		if (rq_load(&runqueues[cpu]) < rq_load(rq))
+			rq = &runqueues[cpu];
+
+	proc->running_list = &rq->running_list;
+	rq_enqueue(rq, proc);
+}
+
+void finish_proc(int cpu, struct pcb_t * proc) {
+	struct runqueue_t * rq = &runqueues[cpu];
+
+	pthread_mutex_lock(&rq->lock);
+	queue_remove(&rq->running_list, proc);
+	pthread_mutex_unlock(&rq->lock);
+	stats_finish(proc, current_time());
+	proc_unregister(proc);
 }
-#endif
 
+int sched_slice(int cpu, struct pcb_t * proc) {
+	return sched_class->time_slice(&runqueues[cpu], proc);
+}
 
+int sched_tick(int cpu, struct pcb_t * proc) {
+	if (sched_class->on_tick == NULL)
+		return 0;
+	return sched_class->on_tick(&runqueues[cpu], proc);
+}
+
+struct kill_args {
+	int (*match)(struct pcb_t * proc, void * arg);
+	void * arg;
+	int killed;
+};
+
+/* Flag one process of the process table to exit. A policy queue may not
+ * be able to drop an element (the MLQ rings cannot), so both running and
+ * queued processes are reaped by the CPU that holds them next */
+static int kill_one(struct pcb_t * proc, void * arg) {
+	struct kill_args * ka = (struct kill_args *) arg;
+
+	// Already on its way out
+	if (proc->pc >= proc->code->size || !ka->match(proc, ka->arg))
+		return 0;
+
+	proc->pc = proc->code->size; // Force exit
+	ka->killed++;
+	return 0;
+}
+
+int kill_procs(int (*match)(struct pcb_t * proc, void * arg), void * arg) {
+	struct kill_args ka = { match, arg, 0 };
+
+	proctbl_for_each(kill_one, &ka);
+	return ka.killed;
+}
@@ -0,0 +1,157 @@
+#include "sched.h"
+#include "sched_class.h"
+#include "rbtree.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * CFS-style fair policy: every CPU orders its ready processes by virtual
+ * runtime in a red-black tree and always runs the leftmost one. A tick
+ * of real run time advances vruntime inversely to the process weight, so
+ * heavier (higher prio) processes get proportionally more CPU but every
+ * process keeps moving towards the left of the tree and is never
+ * starved. Insert and pick are O(log n), the leftmost node is cached.
+ */
+
+#define NICE_0_LOAD	1024
+/* vruntime of one tick at NICE_0_LOAD, in fixed point */
+#define CFS_TICK	(1UL << 20)
+
+/* Linux sched_prio_to_weight[], nice -20 .. 19: each nice step is
+ * about 10% more or less CPU */
+static const unsigned long prio_to_weight[40] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	9548, 7620, 6100, 4904, 3906,
+	3121, 2501, 1991, 1586, 1277,
+	1024, 820, 655, 526, 423,
+	335, 272, 215, 172, 137,
+	110, 87, 70, 56, 45,
+	36, 29, 23, 18, 15,
+};
+
+struct cfs_rq {
+	pthread_mutex_t lock;
+	struct rb_root timeline;
+	struct rb_node * leftmost;
+	uint64_t min_vruntime;	/* monotonic floor of the queued vruntimes */
+	unsigned long load;	/* total weight of the queued procs */
+	int nr;
+};
+
+/* Spread prio 0 .. MAX_PRIO - 1 over the 40 nice levels */
+static unsigned long cfs_weight(struct pcb_t * proc) {
+	int prio = proc->prio < MAX_PRIO ? proc->prio : MAX_PRIO - 1;
+
+	return prio_to_weight[prio * 40 / MAX_PRIO];
+}
+
+static int vruntime_before(struct pcb_t * a, struct pcb_t * b) {
+	int64_t delta = (int64_t)(a->vruntime - b->vruntime);
+
+	return delta != 0 ? delta < 0 : a->pid < b->pid;
+}
+
+static int cfs_init(struct runqueue_t * rq) {
+	struct cfs_rq * cfs = calloc(1, sizeof(struct cfs_rq));
+
+	if (cfs == NULL)
+		return -1;
+	pthread_mutex_init(&cfs->lock, NULL);
+	cfs->timeline = RB_ROOT;
+	rq->priv = cfs;
+	return 0;
+}
+
+static void cfs_exit(struct runqueue_t * rq) {
+	struct cfs_rq * cfs = rq->priv;
+
+	pthread_mutex_destroy(&cfs->lock);
+	free(cfs);
+}
+
+/*
+ * Off the tree a process keeps its vruntime relative to min_vruntime of
+ * the queue it left (0 for a new one), so it neither gains nor loses
+ * ground when it is requeued on, or stolen by, another CPU.
+ */
+static void cfs_enqueue(struct runqueue_t * rq, struct pcb_t * proc) {
+	struct cfs_rq * cfs = rq->priv;
+	struct rb_node ** link, * parent = NULL;
+	int leftmost = 1;
+
+	pthread_mutex_lock(&cfs->lock);
+	proc->vruntime += cfs->min_vruntime;
+
+	link = &cfs->timeline.rb_node;
+	while (*link != NULL) {
+		parent = *link;
+		if (vruntime_before(proc,
+				rb_entry(parent, struct pcb_t, sched_node))) {
+			link = &parent->rb_left;
+		} else {
+			link = &parent->rb_right;
+			leftmost = 0;
+		}
+	}
+	rb_link_node(&proc->sched_node, parent, link);
+	rb_insert_color(&proc->sched_node, &cfs->timeline);
+	if (leftmost)
+		cfs->leftmost = &proc->sched_node;
+
+	cfs->load += cfs_weight(proc);
+	cfs->nr++;
+	pthread_mutex_unlock(&cfs->lock);
+}
+
+static struct pcb_t * cfs_pick_next(struct runqueue_t * rq) {
+	struct cfs_rq * cfs = rq->priv;
+	struct pcb_t * proc;
+
+	pthread_mutex_lock(&cfs->lock);
+	if (cfs->leftmost == NULL) {
+		pthread_mutex_unlock(&cfs->lock);
+		return NULL;
+	}
+	proc = rb_entry(cfs->leftmost, struct pcb_t, sched_node);
+	cfs->leftmost = rb_next(cfs->leftmost);
+	rb_erase(&proc->sched_node, &cfs->timeline);
+	cfs->load -= cfs_weight(proc);
+	cfs->nr--;
+
+	if ((int64_t)(proc->vruntime - cfs->min_vruntime) > 0)
+		cfs->min_vruntime = proc->vruntime;
+	proc->vruntime -= cfs->min_vruntime;
+	pthread_mutex_unlock(&cfs->lock);
+	return proc;
+}
+
+/* Split a period of one time slot per runnable process by weight */
+static int cfs_time_slice(struct runqueue_t * rq, struct pcb_t * proc) {
+	struct cfs_rq * cfs = rq->priv;
+	unsigned long weight = cfs_weight(proc);
+	unsigned long slice;
+
+	pthread_mutex_lock(&cfs->lock);
+	slice = (unsigned long) sched_time_slot * (cfs->nr + 1) * weight /
+		(cfs->load + weight);
+	pthread_mutex_unlock(&cfs->lock);
+	return slice > 0 ? slice : 1;
+}
+
+static int cfs_on_tick(struct runqueue_t * rq, struct pcb_t * proc) {
+	proc->vruntime += CFS_TICK * NICE_0_LOAD / cfs_weight(proc);
+	return 0;
+}
+
+const struct sched_class cfs_sched_class = {
+	.name		= "cfs",
+	.init		= cfs_init,
+	.exit		= cfs_exit,
+	.enqueue	= cfs_enqueue,
+	.requeue	= cfs_enqueue,
+	.pick_next	= cfs_pick_next,
+	.time_slice	= cfs_time_slice,
+	.on_tick	= cfs_on_tick,
+};
@@ -0,0 +1,121 @@
+#include "queue.h"
+#include "sched_class.h"
+#include "timer.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * MLFQ policy: every process enters the top level. A process that uses
+ * up its whole time slice is demoted one level, where it gets twice the
+ * slice but only runs once the levels above are empty. To avoid
+ * starvation every process is boosted back to the top level once per
+ * boost period.
+ */
+
+#define MLFQ_LEVELS		4
+/* Boost period, in time slots of the top level */
+#define MLFQ_BOOST_SLOTS	32
+
+struct mlfq_rq {
+	pthread_mutex_t lock;
+	struct queue_t level[MLFQ_LEVELS];
+	uint64_t boost_gen;	/* boost period the levels belong to */
+};
+
+/* Boost period of the current time. A process whose sched_gen is older
+ * has been boosted since it was last queued */
+static uint64_t boost_gen(void) {
+	return current_time() / (MLFQ_BOOST_SLOTS * sched_time_slot);
+}
+
+static int mlfq_init(struct runqueue_t * rq) {
+	struct mlfq_rq * mq = calloc(1, sizeof(struct mlfq_rq));
+
+	if (mq == NULL)
+		return -1;
+	pthread_mutex_init(&mq->lock, NULL);
+	rq->priv = mq;
+	return 0;
+}
+
+static void mlfq_exit(struct runqueue_t * rq) {
+	struct mlfq_rq * mq = rq->priv;
+
+	pthread_mutex_destroy(&mq->lock);
+	free(mq);
+}
+
+/* Move every queued process of [mq] back to the top level, in level
+ * order. Called with mq->lock held */
+static void mlfq_boost(struct mlfq_rq * mq, uint64_t gen) {
+	struct pcb_t * proc;
+	int lvl;
+
+	for (lvl = 1; lvl < MLFQ_LEVELS; lvl++) {
+		while ((proc = dequeue(&mq->level[lvl])) != NULL) {
+			proc->sched_level = 0;
+			proc->sched_gen = gen;
+			proc->ready_queue = &mq->level[0];
+			enqueue(&mq->level[0], proc);
+		}
+	}
+	mq->boost_gen = gen;
+}
+
+static void mlfq_insert(struct mlfq_rq * mq, struct pcb_t * proc) {
+	uint64_t gen = boost_gen();
+
+	pthread_mutex_lock(&mq->lock);
+	if (gen != mq->boost_gen)
+		mlfq_boost(mq, gen);
+	if (proc->sched_gen != gen) {
+		proc->sched_level = 0;
+		proc->sched_gen = gen;
+	}
+	proc->ready_queue = &mq->level[proc->sched_level];
+	enqueue(&mq->level[proc->sched_level], proc);
+	pthread_mutex_unlock(&mq->lock);
+}
+
+static void mlfq_enqueue(struct runqueue_t * rq, struct pcb_t * proc) {
+	proc->sched_level = 0;
+	proc->sched_gen = boost_gen();
+	mlfq_insert(rq->priv, proc);
+}
+
+/* Only called once the slice ran out => demote */
+static void mlfq_requeue(struct runqueue_t * rq, struct pcb_t * proc) {
+	if (proc->sched_level < MLFQ_LEVELS - 1)
+		proc->sched_level++;
+	mlfq_insert(rq->priv, proc);
+}
+
+static struct pcb_t * mlfq_pick_next(struct runqueue_t * rq) {
+	struct mlfq_rq * mq = rq->priv;
+	struct pcb_t * proc = NULL;
+	uint64_t gen = boost_gen();
+	int lvl;
+
+	pthread_mutex_lock(&mq->lock);
+	if (gen != mq->boost_gen)
+		mlfq_boost(mq, gen);
+	for (lvl = 0; lvl < MLFQ_LEVELS && proc == NULL; lvl++)
+		proc = dequeue(&mq->level[lvl]);
+	pthread_mutex_unlock(&mq->lock);
+	return proc;
+}
+
+static int mlfq_time_slice(struct runqueue_t * rq, struct pcb_t * proc) {
+	return sched_time_slot << proc->sched_level;
+}
+
+const struct sched_class mlfq_sched_class = {
+	.name		= "mlfq",
+	.init		= mlfq_init,
+	.exit		= mlfq_exit,
+	.enqueue	= mlfq_enqueue,
+	.requeue	= mlfq_requeue,
+	.pick_next	= mlfq_pick_next,
+	.time_slice	= mlfq_time_slice,
+};
@@ -0,0 +1,282 @@
+
+#include "sched.h"
+#include "sched_class.h"
+#include "bitops.h"
+#include "mpmc.h"
+#include "queue.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * MLQ policy: one FIFO per priority level, a level with priority [prio]
+ * may dispatch MAX_PRIO - prio times per round before lower levels run.
+ */
+
+/*
+ * Two-level priority bitmap: bit [prio] of map[] is set when the level is
+ * a candidate, bit [w] of summary is set when map[w] is non-zero. Finding
+ * the best level is two find-first-set operations whatever MAX_PRIO is
+ * (up to BITS_PER_ULONG^2 levels). All updates are atomic so producers
+ * and consumers never take a lock; a bit may briefly be stale, which the
+ * dispatch loop detects and repairs.
+ */
+struct prio_bitmap {
+	unsigned long summary;
+	unsigned long map[BITS_TO_LONGS(MAX_PRIO)];
+};
+
+/* Cells of a level ring. A level holding more processes spills into its
+ * overflow FIFO, which keeps taking them until it drained so the level
+ * stays FIFO */
+#define MLQ_RING_SZ	1024
+
+/* MLQ state of one run queue. The levels are lock-free rings, so the
+ * loader, the owner CPU and thieves never block each other as long as
+ * no level overflows */
+struct mlq_rq {
+	/* One ring per level, allocated on first use */
+	struct mpmc_ring * mlq_ready_ring[MAX_PRIO];
+	pthread_mutex_t overflow_lock;
+	struct queue_t overflow[MAX_PRIO];
+	int nr_overflow[MAX_PRIO];
+	struct prio_bitmap ready_map; /* levels holding at least one proc */
+	struct prio_bitmap pick_map;  /* ready levels with slot budget left */
+	/* Slot budget per level: epoch in the high half, slots left in the
+	 * low half. A stale epoch means a full budget, so a refill is a
+	 * single bump of slot_epoch */
+	unsigned long slot_epoch;
+	unsigned long slot[MAX_PRIO];
+};
+
+static void prio_bitmap_set(struct prio_bitmap * bm, int prio) {
+	__atomic_fetch_or(&bm->map[BITMAP_WORD(prio)], BITMAP_MASK(prio),
+			__ATOMIC_RELEASE);
+	__atomic_fetch_or(&bm->summary, BITMAP_MASK(BITMAP_WORD(prio)),
+			__ATOMIC_RELEASE);
+}
+
+static void prio_bitmap_clear(struct prio_bitmap * bm, int prio) {
+	int w = BITMAP_WORD(prio);
+
+	if (__atomic_and_fetch(&bm->map[w], ~BITMAP_MASK(prio),
+			__ATOMIC_ACQ_REL) != 0)
+		return;
+	__atomic_fetch_and(&bm->summary, ~BITMAP_MASK(w), __ATOMIC_ACQ_REL);
+	/* A concurrent set may have landed in between */
+	if (__atomic_load_n(&bm->map[w], __ATOMIC_ACQUIRE) != 0)
+		__atomic_fetch_or(&bm->summary, BITMAP_MASK(w), __ATOMIC_RELEASE);
+}
+
+/* Return the highest priority (lowest value) set in [bm], -1 if none */
+static int prio_bitmap_first(struct prio_bitmap * bm) {
+	unsigned long summary, word;
+	int w;
+
+	for (;;) {
+		summary = __atomic_load_n(&bm->summary, __ATOMIC_ACQUIRE);
+		if (summary == 0)
+			return -1;
+		w = __ffs_ulong(summary);
+		word = __atomic_load_n(&bm->map[w], __ATOMIC_ACQUIRE);
+		if (word != 0)
+			return w * BITS_PER_ULONG + __ffs_ulong(word);
+		/* Summary bit outlived its word, drop it and look again */
+		__atomic_fetch_and(&bm->summary, ~BITMAP_MASK(w), __ATOMIC_ACQ_REL);
+		if (__atomic_load_n(&bm->map[w], __ATOMIC_ACQUIRE) != 0)
+			__atomic_fetch_or(&bm->summary, BITMAP_MASK(w),
+					__ATOMIC_RELEASE);
+	}
+}
+
+#define SLOT_EPOCH_SHIFT (BITS_PER_ULONG / 2)
+#define SLOT_LEFT_MASK   ((1UL << SLOT_EPOCH_SHIFT) - 1)
+
+static unsigned long slot_epoch(struct mlq_rq * mlq) {
+	return __atomic_load_n(&mlq->slot_epoch, __ATOMIC_ACQUIRE) & SLOT_LEFT_MASK;
+}
+
+static int slot_left(struct mlq_rq * mlq, int prio) {
+	unsigned long v = __atomic_load_n(&mlq->slot[prio], __ATOMIC_ACQUIRE);
+
+	if ((v >> SLOT_EPOCH_SHIFT) != slot_epoch(mlq))
+		return MAX_PRIO - prio;
+	return v & SLOT_LEFT_MASK;
+}
+
+/* Consume one slot of [prio]. Return the slots left afterwards */
+static int take_slot(struct mlq_rq * mlq, int prio) {
+	unsigned long epoch, v, nv;
+
+	v = __atomic_load_n(&mlq->slot[prio], __ATOMIC_ACQUIRE);
+	do {
+		epoch = slot_epoch(mlq);
+		if ((v >> SLOT_EPOCH_SHIFT) != epoch)
+			nv = (epoch << SLOT_EPOCH_SHIFT) | (MAX_PRIO - prio);
+		else
+			nv = v;
+		if ((nv & SLOT_LEFT_MASK) > 0)
+			nv--;
+	} while (!__atomic_compare_exchange_n(&mlq->slot[prio], &v, nv, 1,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	return nv & SLOT_LEFT_MASK;
+}
+
+/* Give every level its full budget again */
+static void refill_slots(struct mlq_rq * mlq) {
+	unsigned int w;
+
+	__atomic_fetch_add(&mlq->slot_epoch, 1, __ATOMIC_ACQ_REL);
+	for (w = 0; w < BITS_TO_LONGS(MAX_PRIO); w++)
+		__atomic_store_n(&mlq->pick_map.map[w],
+			__atomic_load_n(&mlq->ready_map.map[w], __ATOMIC_ACQUIRE),
+			__ATOMIC_RELEASE);
+	__atomic_store_n(&mlq->pick_map.summary,
+		__atomic_load_n(&mlq->ready_map.summary, __ATOMIC_ACQUIRE),
+		__ATOMIC_RELEASE);
+}
+
+/* Return the ring of [prio], creating it on first use */
+static struct mpmc_ring * level_ring(struct mlq_rq * mlq, int prio) {
+	struct mpmc_ring * ring, * expected = NULL;
+
+	ring = __atomic_load_n(&mlq->mlq_ready_ring[prio], __ATOMIC_ACQUIRE);
+	if (ring != NULL)
+		return ring;
+
+	ring = mpmc_create(sched_max_procs < MLQ_RING_SZ ?
+		sched_max_procs : MLQ_RING_SZ);
+	if (!__atomic_compare_exchange_n(&mlq->mlq_ready_ring[prio], &expected,
+			ring, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		/* Lost the race, use the winner's ring */
+		mpmc_destroy(ring);
+		ring = expected;
+	}
+	return ring;
+}
+
+/* Oldest process of level [prio], NULL if none */
+static struct pcb_t * level_pop(struct mlq_rq * mlq, int prio,
+		struct mpmc_ring * ring) {
+	struct pcb_t * proc = ring != NULL ? mpmc_pop(ring) : NULL;
+
+	if (proc == NULL &&
+			__atomic_load_n(&mlq->nr_overflow[prio], __ATOMIC_ACQUIRE) > 0) {
+		pthread_mutex_lock(&mlq->overflow_lock);
+		proc = dequeue(&mlq->overflow[prio]);
+		if (proc != NULL)
+			__atomic_fetch_sub(&mlq->nr_overflow[prio], 1,
+				__ATOMIC_RELEASE);
+		pthread_mutex_unlock(&mlq->overflow_lock);
+	}
+	return proc;
+}
+
+static int level_empty(struct mlq_rq * mlq, int prio, struct mpmc_ring * ring) {
+	return (ring == NULL || mpmc_empty(ring)) &&
+		__atomic_load_n(&mlq->nr_overflow[prio], __ATOMIC_ACQUIRE) == 0;
+}
+
+static int mlq_init(struct runqueue_t * rq) {
+	struct mlq_rq * mlq = calloc(1, sizeof(struct mlq_rq));
+
+	if (mlq == NULL)
+		return -1;
+	pthread_mutex_init(&mlq->overflow_lock, NULL);
+	rq->priv = mlq;
+	return 0;
+}
+
+static void mlq_exit(struct runqueue_t * rq) {
+	struct mlq_rq * mlq = rq->priv;
+	int prio;
+
+	for (prio = 0; prio < MAX_PRIO; prio++)
+		if (mlq->mlq_ready_ring[prio] != NULL)
+			mpmc_destroy(mlq->mlq_ready_ring[prio]);
+	pthread_mutex_destroy(&mlq->overflow_lock);
+	free(mlq);
+}
+
+/* Queue [proc] on its prio level of [rq], lock-free */
+static void mlq_enqueue(struct runqueue_t * rq, struct pcb_t * proc) {
+	struct mlq_rq * mlq = rq->priv;
+	int prio = proc->prio < MAX_PRIO ? proc->prio : MAX_PRIO - 1;
+	struct mpmc_ring * ring = level_ring(mlq, prio);
+
+	if (__atomic_load_n(&mlq->nr_overflow[prio], __ATOMIC_ACQUIRE) > 0 ||
+			mpmc_push(ring, proc) < 0) {
+		pthread_mutex_lock(&mlq->overflow_lock);
+		enqueue(&mlq->overflow[prio], proc);
+		__atomic_fetch_add(&mlq->nr_overflow[prio], 1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&mlq->overflow_lock);
+	}
+
+	prio_bitmap_set(&mlq->ready_map, prio);
+	if (slot_left(mlq, prio) > 0)
+		prio_bitmap_set(&mlq->pick_map, prio);
+}
+
+/*
+ *  Stateful design for routine calling
+ *  based on the priority and our MLQ policy
+ *  We implement stateful here using transition technique
+ *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
+ *  Lock-free: any CPU may pick from any run queue concurrently.
+ */
+static struct pcb_t * mlq_pick_next(struct runqueue_t * rq) {
+	struct mlq_rq * mlq = rq->priv;
+	struct mpmc_ring * ring;
+	struct pcb_t * proc;
+	int prio, left;
+
+	for (;;) {
+		// Highest ready prio that still has slot budget
+		prio = prio_bitmap_first(&mlq->pick_map);
+		if (prio < 0) {
+			if (prio_bitmap_first(&mlq->ready_map) < 0)
+				return NULL;
+			// Every ready lvl used up its slots => start a new round
+			refill_slots(mlq);
+			continue;
+		}
+
+		ring = __atomic_load_n(&mlq->mlq_ready_ring[prio], __ATOMIC_ACQUIRE);
+		proc = level_pop(mlq, prio, ring); // Pick proc from rq[prio]
+		if (proc != NULL)
+			break;
+
+		// Lvl drained => drop its bits, unless a producer refilled it
+		prio_bitmap_clear(&mlq->ready_map, prio);
+		prio_bitmap_clear(&mlq->pick_map, prio);
+		if (!level_empty(mlq, prio, ring)) {
+			prio_bitmap_set(&mlq->ready_map, prio);
+			prio_bitmap_set(&mlq->pick_map, prio);
+		}
+	}
+
+	left = take_slot(mlq, prio);
+	if (left == 0)
+		prio_bitmap_clear(&mlq->pick_map, prio);
+
+	// If lowest prio lvl exhausted => reset slot
+	if (prio == MAX_PRIO - 1 && left == 0 && level_empty(mlq, prio, ring))
+		refill_slots(mlq);
+
+	return proc;
+}
+
+static int mlq_time_slice(struct runqueue_t * rq, struct pcb_t * proc) {
+	return sched_time_slot;
+}
+
+const struct sched_class mlq_sched_class = {
+	.name		= "mlq",
+	.init		= mlq_init,
+	.exit		= mlq_exit,
+	.enqueue	= mlq_enqueue,
+	.requeue	= mlq_enqueue,
+	.pick_next	= mlq_pick_next,
+	.time_slice	= mlq_time_slice,
+};
@@ -0,0 +1,82 @@
+#include "queue.h"
+#include "sched_class.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * FIFO and round-robin policies: a single ready queue per CPU in arrival
+ * order. FIFO runs a process until it finishes, RR preempts it after
+ * every time slot and sends it to the back of the queue.
+ */
+
+struct fifo_rq {
+	pthread_mutex_t lock;
+	struct queue_t ready_queue;
+};
+
+static int fifo_init(struct runqueue_t * rq) {
+	struct fifo_rq * fq = calloc(1, sizeof(struct fifo_rq));
+
+	if (fq == NULL)
+		return -1;
+	pthread_mutex_init(&fq->lock, NULL);
+	rq->priv = fq;
+	return 0;
+}
+
+static void fifo_exit(struct runqueue_t * rq) {
+	struct fifo_rq * fq = rq->priv;
+
+	pthread_mutex_destroy(&fq->lock);
+	free(fq);
+}
+
+static void fifo_enqueue(struct runqueue_t * rq, struct pcb_t * proc) {
+	struct fifo_rq * fq = rq->priv;
+
+	pthread_mutex_lock(&fq->lock);
+	proc->ready_queue = &fq->ready_queue;
+	enqueue(&fq->ready_queue, proc);
+	pthread_mutex_unlock(&fq->lock);
+}
+
+static struct pcb_t * fifo_pick_next(struct runqueue_t * rq) {
+	struct fifo_rq * fq = rq->priv;
+	struct pcb_t * proc;
+
+	pthread_mutex_lock(&fq->lock);
+	proc = dequeue(&fq->ready_queue);
+	pthread_mutex_unlock(&fq->lock);
+	return proc;
+}
+
+/* Run to completion */
+static int fifo_time_slice(struct runqueue_t * rq, struct pcb_t * proc) {
+	return INT_MAX;
+}
+
+static int rr_time_slice(struct runqueue_t * rq, struct pcb_t * proc) {
+	return sched_time_slot;
+}
+
+const struct sched_class fifo_sched_class = {
+	.name		= "fifo",
+	.init		= fifo_init,
+	.exit		= fifo_exit,
+	.enqueue	= fifo_enqueue,
+	.requeue	= fifo_enqueue,
+	.pick_next	= fifo_pick_next,
+	.time_slice	= fifo_time_slice,
+};
+
+const struct sched_class rr_sched_class = {
+	.name		= "rr",
+	.init		= fifo_init,
+	.exit		= fifo_exit,
+	.enqueue	= fifo_enqueue,
+	.requeue	= fifo_enqueue,
+	.pick_next	= fifo_pick_next,
+	.time_slice	= rr_time_slice,
+};
@@ -0,0 +1,140 @@
+#include "sched_class.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * Shortest remaining instructions first: each CPU keeps a binary min-heap
+ * keyed on the number of instructions a process has left. A running
+ * process is preempted as soon as a shorter one is queued on its CPU.
+ * The key is taken when a process is queued, as killall moves the pc of
+ * queued processes.
+ */
+
+struct sri_node {
+	int left;	/* instructions left when queued */
+	struct pcb_t * proc;
+};
+
+struct sri_rq {
+	pthread_mutex_t lock;
+	struct sri_node * heap;
+	int size;
+	int cap;
+	int min_left;	/* key of heap[0], INT_MAX when empty */
+};
+
+static int sri_left(struct pcb_t * proc) {
+	return proc->pc < proc->code->size ? proc->code->size - proc->pc : 0;
+}
+
+/* Fewer instructions left first, then lower pid */
+static int sri_before(const struct sri_node * a, const struct sri_node * b) {
+	return a->left != b->left ? a->left < b->left :
+		a->proc->pid < b->proc->pid;
+}
+
+static void sri_update_min(struct sri_rq * sq) {
+	__atomic_store_n(&sq->min_left,
+		sq->size > 0 ? sq->heap[0].left : INT_MAX, __ATOMIC_RELEASE);
+}
+
+static int sri_init(struct runqueue_t * rq) {
+	struct sri_rq * sq = calloc(1, sizeof(struct sri_rq));
+
+	if (sq == NULL)
+		return -1;
+	/* Grown on demand, a CPU can at worst hold every process */
+	sq->cap = sched_max_procs < 64 ? sched_max_procs : 64;
+	sq->heap = malloc(sq->cap * sizeof(struct sri_node));
+	if (sq->heap == NULL) {
+		free(sq);
+		return -1;
+	}
+	pthread_mutex_init(&sq->lock, NULL);
+	sq->min_left = INT_MAX;
+	rq->priv = sq;
+	return 0;
+}
+
+static void sri_exit(struct runqueue_t * rq) {
+	struct sri_rq * sq = rq->priv;
+
+	pthread_mutex_destroy(&sq->lock);
+	free(sq->heap);
+	free(sq);
+}
+
+static void sri_enqueue(struct runqueue_t * rq, struct pcb_t * proc) {
+	struct sri_rq * sq = rq->priv;
+	struct sri_node node = { sri_left(proc), proc };
+	int i, parent;
+
+	pthread_mutex_lock(&sq->lock);
+	if (sq->size == sq->cap) {
+		sq->cap *= 2;
+		sq->heap = realloc(sq->heap, sq->cap * sizeof(struct sri_node));
+	}
+	// Sift up from the new leaf
+	for (i = sq->size++; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (!sri_before(&node, &sq->heap[parent]))
+			break;
+		sq->heap[i] = sq->heap[parent];
+	}
+	sq->heap[i] = node;
+	sri_update_min(sq);
+	pthread_mutex_unlock(&sq->lock);
+}
+
+static struct pcb_t * sri_pick_next(struct runqueue_t * rq) {
+	struct sri_rq * sq = rq->priv;
+	struct pcb_t * proc;
+	struct sri_node last;
+	int i, child;
+
+	pthread_mutex_lock(&sq->lock);
+	if (sq->size == 0) {
+		pthread_mutex_unlock(&sq->lock);
+		return NULL;
+	}
+	proc = sq->heap[0].proc;
+	last = sq->heap[--sq->size];
+	// Sift the last leaf down from the root
+	for (i = 0; (child = 2 * i + 1) < sq->size; i = child) {
+		if (child + 1 < sq->size &&
+				sri_before(&sq->heap[child + 1], &sq->heap[child]))
+			child++;
+		if (!sri_before(&sq->heap[child], &last))
+			break;
+		sq->heap[i] = sq->heap[child];
+	}
+	if (sq->size > 0)
+		sq->heap[i] = last;
+	sri_update_min(sq);
+	pthread_mutex_unlock(&sq->lock);
+	return proc;
+}
+
+static int sri_time_slice(struct runqueue_t * rq, struct pcb_t * proc) {
+	return sched_time_slot;
+}
+
+/* Preempt when a shorter process is waiting on this CPU */
+static int sri_on_tick(struct runqueue_t * rq, struct pcb_t * proc) {
+	struct sri_rq * sq = rq->priv;
+
+	return __atomic_load_n(&sq->min_left, __ATOMIC_ACQUIRE) < sri_left(proc);
+}
+
+const struct sched_class sri_sched_class = {
+	.name		= "sri",
+	.init		= sri_init,
+	.exit		= sri_exit,
+	.enqueue	= sri_enqueue,
+	.requeue	= sri_enqueue,
+	.pick_next	= sri_pick_next,
+	.time_slice	= sri_time_slice,
+	.on_tick	= sri_on_tick,
+};
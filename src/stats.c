@@ -0,0 +1,123 @@
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/* Timelines of the finished processes */
+static struct proc_stats * done;
+static int nr_done, done_cap;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void stats_init(int max_procs) {
+	done_cap = max_procs > 0 ? max_procs : 1;
+	done = malloc(done_cap * sizeof(struct proc_stats));
+	nr_done = 0;
+}
+
+void stats_destroy(void) {
+	free(done);
+	done = NULL;
+	nr_done = done_cap = 0;
+}
+
+void stats_arrive(struct pcb_t * proc, uint64_t now) {
+	proc->stats.arrival = now;
+	proc->stats.last_event = now;
+}
+
+void stats_dispatch(struct pcb_t * proc, uint64_t now) {
+	if (proc->stats.nr_switches == 0)
+		proc->stats.first_run = now;
+	proc->stats.wait += now - proc->stats.last_event;
+	proc->stats.last_event = now;
+	proc->stats.nr_switches++;
+}
+
+void stats_preempt(struct pcb_t * proc, uint64_t now) {
+	proc->stats.run += now - proc->stats.last_event;
+	proc->stats.last_event = now;
+}
+
+void stats_finish(struct pcb_t * proc, uint64_t now) {
+	stats_preempt(proc, now);
+	proc->stats.completion = now;
+
+	pthread_mutex_lock(&stats_lock);
+	if (nr_done == done_cap) {
+		done_cap = done_cap > 0 ? 2 * done_cap : 16;
+		done = realloc(done, done_cap * sizeof(struct proc_stats));
+	}
+	done[nr_done++] = proc->stats;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+int stats_finished(uint64_t * last) {
+	int i, n;
+
+	pthread_mutex_lock(&stats_lock);
+	*last = 0;
+	for (i = 0; i < nr_done; i++)
+		if (done[i].completion > *last)
+			*last = done[i].completion;
+	n = nr_done;
+	pthread_mutex_unlock(&stats_lock);
+	return n;
+}
+
+static int cmp_tick(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of the sorted [v] */
+static uint64_t percentile(uint64_t * v, int n, int p) {
+	int rank = (p * n + 99) / 100;
+
+	return v[rank > 0 ? rank - 1 : 0];
+}
+
+static void report_line(FILE * out, const char * name, uint64_t * v, int n) {
+	uint64_t sum = 0;
+	int i;
+
+	qsort(v, n, sizeof(uint64_t), cmp_tick);
+	for (i = 0; i < n; i++)
+		sum += v[i];
+	fprintf(out, "\t%-12s avg %8.2f  p50 %6lu  p95 %6lu  p99 %6lu  max %6lu\n",
+		name, (double) sum / n, percentile(v, n, 50),
+		percentile(v, n, 95), percentile(v, n, 99), v[n - 1]);
+}
+
+void stats_report(FILE * out) {
+	uint64_t * v;
+	uint64_t switches = 0;
+	int i;
+
+	pthread_mutex_lock(&stats_lock);
+	if (nr_done == 0) {
+		pthread_mutex_unlock(&stats_lock);
+		return;
+	}
+	v = malloc(nr_done * sizeof(uint64_t));
+
+	fprintf(out, "Scheduling stats of %d processes (ticks):\n", nr_done);
+	for (i = 0; i < nr_done; i++)
+		v[i] = done[i].wait;
+	report_line(out, "wait", v, nr_done);
+	for (i = 0; i < nr_done; i++)
+		v[i] = done[i].first_run - done[i].arrival;
+	report_line(out, "response", v, nr_done);
+	for (i = 0; i < nr_done; i++)
+		v[i] = done[i].completion - done[i].arrival;
+	report_line(out, "turnaround", v, nr_done);
+	for (i = 0; i < nr_done; i++)
+		v[i] = done[i].run;
+	report_line(out, "run", v, nr_done);
+	for (i = 0; i < nr_done; i++)
+		switches += done[i].nr_switches;
+	fprintf(out, "\tcontext switches %lu\n", switches);
+
+	free(v);
+	pthread_mutex_unlock(&stats_lock);
+}
@@ -12,12 +12,32 @@
 #include "syscall.h"
 #include "stdio.h"
 #include "libmem.h"
-#include "queue.h"
+#include "sched.h"
 #include <string.h>
 #include <stdlib.h>
-#include <pthread.h>
 
-static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+/* Match a process, other than the caller, whose path contains the name */
+struct kill_target {
+    struct pcb_t *caller;
+    const char *proc_name;
+};
+
+static int match_proc_name(struct pcb_t *proc, void *arg){
+    struct kill_target *target = (struct kill_target *) arg;
+
+    // Skip self
+    if (proc->pid == target->caller->pid)
+        return 0;
+
+    // Match name by checking if path contains proc_name
+    if (strstr(proc->path, target->proc_name) == NULL)
+        return 0;
+
+#ifdef DEBUG
+    printf("Terminating process PID: %d PRIO: %d\n", proc->pid, proc->prio);
+#endif
+    return 1;
+}
 
 int __sys_killall(struct pcb_t *caller, struct sc_regs* regs){
     char proc_name[100];
@@ -37,57 +57,11 @@ int __sys_killall(struct pcb_t *caller, struct sc_regs* regs){
 
     printf("The procname retrieved from memregionid %d is \"%s\"\n", memrg, proc_name);
 
-    i = 0;
-    /* === Traverse running list to kill procs with matching name === */
-    while (i < caller->running_list->size) {
-        struct pcb_t *target_proc = caller->running_list->proc[i];
-        
-        // Skip null proc or self
-        if (caller->running_list->proc[i] == NULL || target_proc->pid == caller->pid) {
-            i++;
-            continue;
-        }
-
-        // Match name by checking if path contains proc_name
-        if (strstr(target_proc->path, proc_name) != NULL) {
-            pthread_mutex_lock(&lock);
-#ifdef DEBUG
-            printf("Terminating process PID: %d PRIO: %d\n", target_proc->pid, target_proc->prio);
-#endif      
-            // Mark process as terminated by setting PC to EOF
-            peek_at_id(caller->running_list, target_proc->pid);
-            target_proc->pc = target_proc->code->size;  // Force exit
-            pthread_mutex_unlock(&lock);
-            continue; // Stay at index i since current slot is shifted
-        } 
-        i++;
-    }
-    
-#ifdef MLQ_SCHED
-    /* === Traverse MLQ ready queues to kill procs with matching name === */
-    for(int q = 0; q < MAX_PRIO; q++){
-        i = 0;
-        while(i < caller->mlq_ready_queue[q].size) {
-            struct pcb_t *target_proc = caller->mlq_ready_queue[q].proc[i];
-            
-            if (target_proc == NULL || target_proc->pid == caller->pid) {
-                i++;
-                continue;
-            }
-            if (strstr(target_proc->path, proc_name) != NULL) {
-                pthread_mutex_lock(&lock);
-#ifdef DEBUG
-                printf("Terminating process PID: %d PRIO: %d\n", target_proc->pid, target_proc->prio);
-#endif      
-                peek_at_index(&caller->mlq_ready_queue[q], i); // Dealloc PCB
-                free(target_proc);
-                pthread_mutex_unlock(&lock);
-                continue;
-            }
-            i++;
-        }
-    }
-#endif
+    /* Matching procs get their pc moved to the end of their code:
+     * running ones exit at their next step, queued ones stay queued
+     * and exit when next dispatched */
+    struct kill_target target = { caller, proc_name };
+    kill_procs(match_proc_name, &target);
 
     return 0; 
 }
@@ -1,7 +1,36 @@
 
 #include "timer.h"
+#include "coro.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Tick barrier. Every attached device calls next_slot() once per time
+ * slot; the last one to arrive wakes the timer, which advances _time and
+ * releases everybody by flipping the barrier generation. A tick costs the
+ * timer O(1) whatever the number of devices: one counter to watch and one
+ * generation to bump. Waiters spin for a while before they block, so on
+ * a multi-core host most ticks complete without any mutex or condvar.
+ *
+ * A device that knows it will not interact with the others for a few
+ * slots leaves the barrier for that long (next_slots()); it sits in the
+ * away list, sorted by the slot it comes back in, and the timer only
+ * checks the head of that list per tick.
+ *
+ * A coroutine device (coro.h) is not part of the barrier: its worker is,
+ * and waiting for a slot on it only yields back to the worker.
+ *
+ * In parallel mode there is no timer thread and no global slot: each
+ * device has a local clock and clock_sync() waits for the slowest one.
+ *
+ * In tickless mode each device also reports the next slot it has work
+ * in; when none of them has work in the coming slot, the timer jumps
+ * straight to the earliest reported one.
+ */
+
+/* Spins before blocking, only used on multi-core hosts */
+#define TIMER_SPIN	1000
 
 static pthread_t _timer;
 
@@ -16,42 +45,121 @@ static uint64_t _time;
 
 static int timer_started = 0;
 static int timer_stop = 0;
+static int spin_limit;
+
+static int tickless;		/* fast-forward over idle slots */
+static uint64_t next_event = TIMER_NO_EVENT; /* earliest slot any device
+					     * has work in */
+
+static int nr_active;		/* attached and not yet detached devices */
+static int nr_arrived;		/* devices done with the current slot */
+static int nr_away;		/* devices out of the barrier for a while */
+static struct timer_id_t * away_list;	/* sorted by wake, barrier_lock */
+static unsigned int generation;	/* bumped when a new slot starts */
+
+static pthread_mutex_t barrier_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t slot_cond = PTHREAD_COND_INITIALIZER;
+static int timer_sleeping;
+static int nr_sleepers;
+
+/* Parallel mode */
+static __thread struct timer_id_t * local_dev;
+
+static int slot_complete(void) {
+	return __atomic_load_n(&nr_arrived, __ATOMIC_SEQ_CST) >=
+		__atomic_load_n(&nr_active, __ATOMIC_SEQ_CST);
+}
+
+/* Called after nr_arrived or nr_active changed */
+static void wake_timer(void) {
+	if (__atomic_load_n(&timer_sleeping, __ATOMIC_SEQ_CST) &&
+			slot_complete()) {
+		pthread_mutex_lock(&barrier_lock);
+		pthread_cond_signal(&timer_cond);
+		pthread_mutex_unlock(&barrier_lock);
+	}
+}
+
+static void wait_slot_complete(void) {
+	int spin;
+
+	for (spin = 0; spin < spin_limit; spin++)
+		if (slot_complete())
+			return;
+
+	pthread_mutex_lock(&barrier_lock);
+	__atomic_store_n(&timer_sleeping, 1, __ATOMIC_SEQ_CST);
+	while (!slot_complete())
+		pthread_cond_wait(&timer_cond, &barrier_lock);
+	__atomic_store_n(&timer_sleeping, 0, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&barrier_lock);
+}
 
+/* Count the away devices due by slot [next] in again, and never skip
+ * past the first one still away. Return the slot to move to, the
+ * devices back are moved to [back] */
+static uint64_t rejoin_away(uint64_t next, struct timer_id_t ** back) {
+	struct timer_id_t * dev;
+
+	pthread_mutex_lock(&barrier_lock);
+	if (away_list != NULL && away_list->wake < next)
+		next = away_list->wake;
+	while ((dev = away_list) != NULL && dev->wake <= next) {
+		away_list = dev->next_away;
+		dev->next_away = *back;
+		*back = dev;
+		__atomic_fetch_sub(&nr_away, 1, __ATOMIC_SEQ_CST);
+		__atomic_fetch_add(&nr_active, 1, __ATOMIC_SEQ_CST);
+	}
+	pthread_mutex_unlock(&barrier_lock);
+	return next;
+}
 
 static void * timer_routine(void * args) {
+	struct timer_id_t * back, * dev, * rejoined;
+	uint64_t next;
+
 	while (!timer_stop) {
 		printf("Time slot %3lu\n", current_time());
-		int fsh = 0;
-		int event = 0;
 		/* Wait for all devices have done the job in current
 		 * time slot */
-		struct timer_id_container_t * temp;
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.event_lock);
-			while (!temp->id.done && !temp->id.fsh) {
-				pthread_cond_wait(
-					&temp->id.event_cond,
-					&temp->id.event_lock
-				);
-			}
-			if (temp->id.fsh) {
-				fsh++;
+		wait_slot_complete();
+
+		/* Increase the time slot, or jump to the next one where any
+		 * device has work when all of them are idle */
+		next = _time + 1;
+		if (tickless && next_event != TIMER_NO_EVENT && next_event > next)
+			next = next_event;
+		back = NULL;
+		if (__atomic_load_n(&nr_away, __ATOMIC_SEQ_CST) > 0)
+			next = rejoin_away(next, &back);
+		rejoined = back;
+		__atomic_store_n(&_time, next, __ATOMIC_SEQ_CST);
+
+		/* Let devices continue their job. Reset the count before
+		 * the new generation lets anybody arrive again */
+		__atomic_store_n(&next_event, TIMER_NO_EVENT, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&nr_arrived, 0, __ATOMIC_SEQ_CST);
+		__atomic_fetch_add(&generation, 1, __ATOMIC_SEQ_CST);
+		if (rejoined != NULL) {
+			/* Wake each device back on its own condvar, the ones
+			 * still away keep sleeping */
+			pthread_mutex_lock(&barrier_lock);
+			while ((dev = back) != NULL) {
+				back = dev->next_away;
+				__atomic_store_n(&dev->away, 0, __ATOMIC_RELEASE);
+				pthread_cond_signal(&dev->away_cond);
 			}
-			event++;
-			pthread_mutex_unlock(&temp->id.event_lock);
+			pthread_mutex_unlock(&barrier_lock);
 		}
-
-		/* Increase the time slot */
-		_time++;
-		
-		/* Let devices continue their job */
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.timer_lock);
-			temp->id.done = 0;
-			pthread_cond_signal(&temp->id.timer_cond);
-			pthread_mutex_unlock(&temp->id.timer_lock);
+		if (__atomic_load_n(&nr_sleepers, __ATOMIC_SEQ_CST) > 0) {
+			pthread_mutex_lock(&barrier_lock);
+			pthread_cond_broadcast(&slot_cond);
+			pthread_mutex_unlock(&barrier_lock);
 		}
-		if (fsh == event) {
+		if (__atomic_load_n(&nr_active, __ATOMIC_SEQ_CST) == 0 &&
+				__atomic_load_n(&nr_away, __ATOMIC_SEQ_CST) == 0) {
 			break;
 		}
 	}
@@ -59,25 +167,139 @@ static void * timer_routine(void * args) {
 }
 
 void next_slot(struct timer_id_t * timer_id) {
+	next_slot_until(timer_id, current_time() + 1);
+}
+
+void next_slot_until(struct timer_id_t * timer_id, uint64_t slot) {
+	unsigned int gen = __atomic_load_n(&generation, __ATOMIC_SEQ_CST);
+	uint64_t event = __atomic_load_n(&next_event, __ATOMIC_SEQ_CST);
+	int spin;
+
+	if (timer_id->coro != NULL) {
+		coro_next_slot_until(timer_id, slot);
+		return;
+	}
+
+	/* Let the timer know when we have work again */
+	while (slot < event && !__atomic_compare_exchange_n(&next_event,
+			&event, slot, 1, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+		;
+
 	/* Tell to timer that we have done our job in current slot */
-	pthread_mutex_lock(&timer_id->event_lock);
-	timer_id->done = 1;
-	pthread_cond_signal(&timer_id->event_cond);
-	pthread_mutex_unlock(&timer_id->event_lock);
+	__atomic_fetch_add(&nr_arrived, 1, __ATOMIC_SEQ_CST);
+	wake_timer();
 
 	/* Wait for going to next slot */
-	pthread_mutex_lock(&timer_id->timer_lock);
-	while (timer_id->done) {
-		pthread_cond_wait(
-			&timer_id->timer_cond,
-			&timer_id->timer_lock
-		);
+	for (spin = 0; spin < spin_limit; spin++)
+		if (__atomic_load_n(&generation, __ATOMIC_ACQUIRE) != gen)
+			return;
+
+	pthread_mutex_lock(&barrier_lock);
+	__atomic_fetch_add(&nr_sleepers, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&generation, __ATOMIC_SEQ_CST) == gen)
+		pthread_cond_wait(&slot_cond, &barrier_lock);
+	__atomic_fetch_sub(&nr_sleepers, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&barrier_lock);
+}
+
+void next_slots(struct timer_id_t * timer_id, uint64_t nr_slots) {
+	struct timer_id_t ** link;
+	int spin;
+
+	if (timer_id->coro != NULL) {
+		coro_next_slots(timer_id, nr_slots);
+		return;
 	}
-	pthread_mutex_unlock(&timer_id->timer_lock);
+	if (nr_slots <= 1) {
+		next_slot(timer_id);
+		return;
+	}
+
+	/* Leave the barrier until slot now + [nr_slots] */
+	timer_id->wake = _time + nr_slots;
+	timer_id->away = 1;
+	pthread_mutex_lock(&barrier_lock);
+	for (link = &away_list; *link != NULL; link = &(*link)->next_away)
+		if ((*link)->wake > timer_id->wake)
+			break;
+	timer_id->next_away = *link;
+	*link = timer_id;
+	__atomic_fetch_add(&nr_away, 1, __ATOMIC_SEQ_CST);
+	__atomic_fetch_sub(&nr_active, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&barrier_lock);
+	wake_timer();
+
+	/* Wait for our slot, the timer counts us in again before it starts */
+	for (spin = 0; spin < spin_limit; spin++)
+		if (!__atomic_load_n(&timer_id->away, __ATOMIC_ACQUIRE))
+			return;
+
+	pthread_mutex_lock(&barrier_lock);
+	while (__atomic_load_n(&timer_id->away, __ATOMIC_ACQUIRE))
+		pthread_cond_wait(&timer_id->away_cond, &barrier_lock);
+	pthread_mutex_unlock(&barrier_lock);
 }
 
 uint64_t current_time() {
-	return _time;
+	if (local_dev != NULL)
+		return __atomic_load_n(&local_dev->clock, __ATOMIC_RELAXED);
+	return __atomic_load_n(&_time, __ATOMIC_RELAXED);
+}
+
+void bind_clock(struct timer_id_t * timer_id) {
+	local_dev = timer_id;
+}
+
+uint64_t clock_of(struct timer_id_t * timer_id) {
+	return __atomic_load_n(&timer_id->clock, __ATOMIC_ACQUIRE);
+}
+
+void clock_advance(struct timer_id_t * timer_id, uint64_t slot) {
+	__atomic_store_n(&timer_id->clock, slot, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&timer_id->nr_clock_waiters, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&barrier_lock);
+		pthread_cond_broadcast(&timer_id->clock_cond);
+		pthread_mutex_unlock(&barrier_lock);
+	}
+}
+
+/* First device but [self] still before [slot], NULL if none */
+static struct timer_id_t * clock_behind(struct timer_id_t * self,
+		uint64_t slot) {
+	struct timer_id_container_t * temp;
+
+	for (temp = dev_list; temp != NULL; temp = temp->next)
+		if (&temp->id != self && clock_of(&temp->id) < slot)
+			return &temp->id;
+	return NULL;
+}
+
+void clock_sync(struct timer_id_t * timer_id, uint64_t slot) {
+	struct timer_id_t * dev;
+	int spin;
+
+	for (spin = 0; spin < spin_limit; spin++)
+		if (clock_behind(timer_id, slot) == NULL)
+			return;
+
+	/* Sleep on one laggard at a time, so that an advance only wakes
+	 * the devices it may release */
+	while ((dev = clock_behind(timer_id, slot)) != NULL) {
+		pthread_mutex_lock(&barrier_lock);
+		__atomic_fetch_add(&dev->nr_clock_waiters, 1, __ATOMIC_SEQ_CST);
+		while (clock_of(dev) < slot)
+			pthread_cond_wait(&dev->clock_cond, &barrier_lock);
+		__atomic_fetch_sub(&dev->nr_clock_waiters, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&barrier_lock);
+	}
+}
+
+void set_time(uint64_t slot) {
+	_time = slot;
+}
+
+void set_tickless(int enable) {
+	tickless = enable;
 }
 
 void start_timer() {
@@ -86,10 +308,13 @@ void start_timer() {
 }
 
 void detach_event(struct timer_id_t * event) {
-	pthread_mutex_lock(&event->event_lock);
 	event->fsh = 1;
-	pthread_cond_signal(&event->event_cond);
-	pthread_mutex_unlock(&event->event_lock);
+	if (event->coro != NULL)
+		return;	/* its worker detaches once all its coroutines are */
+	/* Never hold back the parallel mode again */
+	clock_advance(event, TIMER_NO_EVENT);
+	__atomic_fetch_sub(&nr_active, 1, __ATOMIC_SEQ_CST);
+	wake_timer();
 }
 
 struct timer_id_t * attach_event() {
@@ -98,35 +323,39 @@ struct timer_id_t * attach_event() {
 	}else{
 		struct timer_id_container_t * container =
 			(struct timer_id_container_t*)malloc(
-				sizeof(struct timer_id_container_t)		
+				sizeof(struct timer_id_container_t)
 			);
-		container->id.done = 0;
 		container->id.fsh = 0;
-		pthread_cond_init(&container->id.event_cond, NULL);
-		pthread_mutex_init(&container->id.event_lock, NULL);
-		pthread_cond_init(&container->id.timer_cond, NULL);
-		pthread_mutex_init(&container->id.timer_lock, NULL);
+		container->id.away = 0;
+		container->id.next_away = NULL;
+		container->id.clock = 0;
+		container->id.nr_clock_waiters = 0;
+		container->id.coro = NULL;
+		pthread_cond_init(&container->id.away_cond, NULL);
+		pthread_cond_init(&container->id.clock_cond, NULL);
 		if (dev_list == NULL) {
+			spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ?
+				TIMER_SPIN : 0;
 			dev_list = container;
 			dev_list->next = NULL;
 		}else{
 			container->next = dev_list;
 			dev_list = container;
 		}
+		nr_active++;
 		return &(container->id);
 	}
 }
 
 void stop_timer() {
 	timer_stop = 1;
-	pthread_join(_timer, NULL);
+	if (timer_started)
+		pthread_join(_timer, NULL);
 	while (dev_list != NULL) {
 		struct timer_id_container_t * temp = dev_list;
 		dev_list = dev_list->next;
-		pthread_cond_destroy(&temp->id.event_cond);
-		pthread_mutex_destroy(&temp->id.event_lock);
-		pthread_cond_destroy(&temp->id.timer_cond);
-		pthread_mutex_destroy(&temp->id.timer_lock);
+		pthread_cond_destroy(&temp->id.away_cond);
+		pthread_cond_destroy(&temp->id.clock_cond);
 		free(temp);
 	}
 }
@@ -0,0 +1,479 @@
+#include <stdint.h>
+#include "os-cfg.h"
+#include "os-mm.h"
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*
+ * Synthetic workload generator. It writes a config with [nr_procs]
+ * processes and the [nr_progs] programs they run, drawn from a seeded
+ * generator so the same options always give the same files.
+ *
+ * Programs only touch memory they allocated and free every region before
+ * their end, so a workload runs to completion whatever its mix.
+ */
+
+enum ins_kind { K_CALC, K_ALLOC, K_FREE, K_READ, K_WRITE, K_SYSCALL, NR_KINDS };
+
+static const char * kind_name[NR_KINDS] = {
+	"calc", "alloc", "free", "read", "write", "syscall"
+};
+
+/* System call issued by the generated programs, it only prints its
+ * argument, see sys_xxxhandler.c */
+#define WL_SYSCALL_NR	440
+
+enum arrival { ARR_ZERO, ARR_UNIFORM, ARR_POISSON, ARR_BURST };
+
+/* Priorities are drawn from weighted ranges */
+struct prio_range {
+	unsigned long lo, hi;
+	unsigned long weight;
+};
+
+#define MAX_PRIO_RANGES	16
+
+static struct {
+	const char * dir;
+	const char * name;
+	unsigned long nr_procs;
+	unsigned long nr_progs;
+	unsigned long time_slot;
+	unsigned long nr_cpus;
+	const char * policy;
+	unsigned long ram, swap;
+	enum arrival arrival;
+	unsigned long burst;
+	unsigned long span;
+	unsigned long len_min, len_max;
+	unsigned long size_min, size_max;
+	unsigned long nr_regs;
+	unsigned long mix[NR_KINDS];
+	struct prio_range prio[MAX_PRIO_RANGES];
+	int nr_prio;
+	uint64_t seed;
+} wl = {
+	.dir = "input",
+	.name = "wl",
+	.nr_procs = 10,
+	.time_slot = 2,
+	.nr_cpus = 4,
+	.ram = 1048576,
+	.swap = 16777216,
+	.arrival = ARR_UNIFORM,
+	.burst = 16,
+	.len_min = 10, .len_max = 40,
+	.size_min = 64, .size_max = 512,
+	.nr_regs = 8,
+	.mix = { 50, 12, 10, 10, 12, 6 },
+	.prio = { { 0, MAX_PRIO - 1, 1 } },
+	.nr_prio = 1,
+	.seed = 1,
+};
+
+/* xorshift64*, the same stream on every host */
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+/* Uniform in [lo, hi] */
+static unsigned long rng_range(unsigned long lo, unsigned long hi) {
+	return lo + rng_next() % (hi - lo + 1);
+}
+
+/* Uniform in (0, 1] */
+static double rng_unit(void) {
+	return ((rng_next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static unsigned long pick_prio(void) {
+	unsigned long total = 0, w;
+	int i;
+
+	for (i = 0; i < wl.nr_prio; i++)
+		total += wl.prio[i].weight;
+	w = rng_next() % total;
+	for (i = 0; w >= wl.prio[i].weight; i++)
+		w -= wl.prio[i].weight;
+	return rng_range(wl.prio[i].lo, wl.prio[i].hi);
+}
+
+/* Draw an instruction kind from the mix, among the [allowed] ones */
+static enum ins_kind pick_kind(const int allowed[NR_KINDS]) {
+	unsigned long total = 0, w;
+	int k;
+
+	for (k = 0; k < NR_KINDS; k++)
+		if (allowed[k])
+			total += wl.mix[k];
+	if (total == 0)
+		return K_CALC;
+	w = rng_next() % total;
+	for (k = 0; !allowed[k] || w >= wl.mix[k]; k++)
+		if (allowed[k])
+			w -= wl.mix[k];
+	return k;
+}
+
+/* Index of a random register whose allocation state is [allocated] */
+static unsigned long pick_reg(const unsigned long * size, int allocated,
+		unsigned long nr) {
+	unsigned long r, n = rng_range(0, nr - 1);
+
+	for (r = 0; ; r++)
+		if ((size[r] != 0) == allocated && n-- == 0)
+			return r;
+}
+
+static int write_prog(const char * path, unsigned long prio) {
+	unsigned long size[PAGING_MAX_SYMTBL_SZ] = { 0 };
+	unsigned long len = rng_range(wl.len_min, wl.len_max);
+	unsigned long nr_alloc = 0, i, r;
+	FILE * file = fopen(path, "w");
+
+	if (file == NULL)
+		return -1;
+	fprintf(file, "%lu %lu\n", prio, len);
+	for (i = 0; i < len; i++) {
+		unsigned long left = len - i;
+		int allowed[NR_KINDS] = { 1, 1, 1, 1, 1, 1 };
+		enum ins_kind k;
+
+		/* Keep room to free every region before the end */
+		allowed[K_ALLOC] = nr_alloc < wl.nr_regs && nr_alloc + 1 < left;
+		allowed[K_FREE] = allowed[K_READ] = allowed[K_WRITE] =
+			nr_alloc > 0;
+		k = left <= nr_alloc ? K_FREE : pick_kind(allowed);
+
+		fprintf(file, "%s", kind_name[k]);
+		switch (k) {
+		case K_ALLOC:
+			r = pick_reg(size, 0, wl.nr_regs - nr_alloc);
+			size[r] = rng_range(wl.size_min, wl.size_max);
+			nr_alloc++;
+			fprintf(file, " %lu %lu", size[r], r);
+			break;
+		case K_FREE:
+			r = pick_reg(size, 1, nr_alloc);
+			size[r] = 0;
+			nr_alloc--;
+			fprintf(file, " %lu", r);
+			break;
+		case K_READ:
+			r = pick_reg(size, 1, nr_alloc);
+			fprintf(file, " %lu %lu %lu", r, rng_range(0, size[r] - 1),
+				rng_range(0, wl.nr_regs - 1));
+			break;
+		case K_WRITE:
+			r = pick_reg(size, 1, nr_alloc);
+			fprintf(file, " %lu %lu %lu", rng_range(0, 255), r,
+				rng_range(0, size[r] - 1));
+			break;
+		case K_SYSCALL:
+			fprintf(file, " %d %lu", WL_SYSCALL_NR, rng_range(0, 999));
+			break;
+		default:
+			break;
+		}
+		fputc('\n', file);
+	}
+	return fclose(file);
+}
+
+static int cmp_ulong(const void * a, const void * b) {
+	unsigned long x = *(const unsigned long *) a;
+	unsigned long y = *(const unsigned long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Arrival times of the processes, in ascending order */
+static unsigned long * arrivals(void) {
+	unsigned long * t = malloc(wl.nr_procs * sizeof(unsigned long));
+	double mean = (double) wl.span / wl.nr_procs, now = 0;
+	unsigned long i, nr_bursts;
+
+	for (i = 0; i < wl.nr_procs; i++) {
+		switch (wl.arrival) {
+		case ARR_ZERO:
+			t[i] = 0;
+			break;
+		case ARR_UNIFORM:
+			t[i] = rng_range(0, wl.span);
+			break;
+		case ARR_POISSON:
+			t[i] = (unsigned long) now;
+			now += -log(rng_unit()) * mean;
+			break;
+		case ARR_BURST:
+			nr_bursts = (wl.nr_procs + wl.burst - 1) / wl.burst;
+			t[i] = nr_bursts > 1 ?
+				i / wl.burst * wl.span / (nr_bursts - 1) : 0;
+			break;
+		}
+	}
+	if (wl.arrival == ARR_UNIFORM)
+		qsort(t, wl.nr_procs, sizeof(unsigned long), cmp_ulong);
+	return t;
+}
+
+static void usage(void) {
+	printf("Usage: wlgen [options]\n");
+	printf("  Writes the config [dir]/[name] and its programs\n"
+	       "  [dir]/proc/[name]_0 ... [name]_<progs - 1>\n");
+	printf("  -n, --procs=N       processes, 10 by default\n");
+	printf("  -k, --progs=N       distinct programs, min(procs, 100) by\n"
+	       "                      default\n");
+	printf("  -o, --name=NAME     config name, wl by default\n");
+	printf("  -d, --dir=DIR       input directory, input by default\n");
+	printf("  -s, --seed=N        random seed, 1 by default\n");
+	printf("  -c, --cpus=N        simulated CPUs, 4 by default\n");
+	printf("  -q, --slot=N        time slot, 2 by default\n");
+	printf("  -p, --policy=P      scheduling policy of the config\n");
+	printf("  -m, --memory=R,S    RAM and swap sizes in bytes\n");
+	printf("  -a, --arrival=A     zero, uniform (default), poisson or\n"
+	       "                      burst[:size] arrivals\n");
+	printf("  -t, --span=T        ticks the arrivals spread over, by default\n"
+	       "                      the time the CPUs take to run them all\n");
+	printf("  -l, --length=LO-HI  instructions per program, 10-40 by\n"
+	       "                      default\n");
+	printf("  -z, --size=LO-HI    bytes per allocation, 64-512 by default\n");
+	printf("  -r, --regs=N        registers used per program, 8 by default\n");
+	printf("  -x, --mix=SPEC      instruction weights, by default\n"
+	       "                      calc:50,alloc:12,free:10,read:10,write:12,\n"
+	       "                      syscall:6\n");
+	printf("  -P, --prio=SPEC     priority ranges and weights, such as\n"
+	       "                      0-9:3,100-139:1; 0-139:1 by default\n");
+}
+
+/* "LO-HI" or "N" */
+static int parse_range(const char * s, unsigned long * lo, unsigned long * hi) {
+	char * end;
+
+	*lo = strtoul(s, &end, 10);
+	if (end == s)
+		return -1;
+	*hi = *lo;
+	if (*end == '-') {
+		s = end + 1;
+		*hi = strtoul(s, &end, 10);
+		if (end == s)
+			return -1;
+	}
+	return *end == '\0' && *lo <= *hi ? 0 : -1;
+}
+
+static int parse_mix(char * spec) {
+	unsigned long mix[NR_KINDS] = { 0 };
+	char * tok, * w;
+	int k;
+
+	for (tok = strtok(spec, ","); tok; tok = strtok(NULL, ",")) {
+		if ((w = strchr(tok, ':')) == NULL)
+			return -1;
+		*w++ = '\0';
+		for (k = 0; k < NR_KINDS && strcmp(tok, kind_name[k]); k++)
+			;
+		if (k == NR_KINDS)
+			return -1;
+		mix[k] = strtoul(w, NULL, 10);
+	}
+	memcpy(wl.mix, mix, sizeof(mix));
+	return 0;
+}
+
+static int parse_prio(char * spec) {
+	char * tok, * w;
+
+	wl.nr_prio = 0;
+	for (tok = strtok(spec, ","); tok; tok = strtok(NULL, ",")) {
+		struct prio_range * p = &wl.prio[wl.nr_prio];
+
+		if (wl.nr_prio == MAX_PRIO_RANGES)
+			return -1;
+		p->weight = 1;
+		if ((w = strchr(tok, ':')) != NULL) {
+			*w++ = '\0';
+			p->weight = strtoul(w, NULL, 10);
+		}
+		if (parse_range(tok, &p->lo, &p->hi) < 0 ||
+				p->hi >= MAX_PRIO || p->weight == 0)
+			return -1;
+		wl.nr_prio++;
+	}
+	return wl.nr_prio > 0 ? 0 : -1;
+}
+
+static int parse_args(int argc, char * argv[]) {
+	static const struct option options[] = {
+		{ "procs", required_argument, NULL, 'n' },
+		{ "progs", required_argument, NULL, 'k' },
+		{ "name", required_argument, NULL, 'o' },
+		{ "dir", required_argument, NULL, 'd' },
+		{ "seed", required_argument, NULL, 's' },
+		{ "cpus", required_argument, NULL, 'c' },
+		{ "slot", required_argument, NULL, 'q' },
+		{ "policy", required_argument, NULL, 'p' },
+		{ "memory", required_argument, NULL, 'm' },
+		{ "arrival", required_argument, NULL, 'a' },
+		{ "span", required_argument, NULL, 't' },
+		{ "length", required_argument, NULL, 'l' },
+		{ "size", required_argument, NULL, 'z' },
+		{ "regs", required_argument, NULL, 'r' },
+		{ "mix", required_argument, NULL, 'x' },
+		{ "prio", required_argument, NULL, 'P' },
+		{ NULL, 0, NULL, 0 }
+	};
+	long span = -1;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "n:k:o:d:s:c:q:p:m:a:t:l:z:r:x:P:",
+			options, NULL)) != -1) {
+		switch (opt) {
+		case 'n':
+			wl.nr_procs = strtoul(optarg, NULL, 10);
+			break;
+		case 'k':
+			wl.nr_progs = strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			wl.name = optarg;
+			break;
+		case 'd':
+			wl.dir = optarg;
+			break;
+		case 's':
+			wl.seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'c':
+			wl.nr_cpus = strtoul(optarg, NULL, 10);
+			break;
+		case 'q':
+			wl.time_slot = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			wl.policy = optarg;
+			break;
+		case 'm':
+			if (sscanf(optarg, "%lu,%lu", &wl.ram, &wl.swap) != 2)
+				return -1;
+			break;
+		case 'a':
+			if (strcmp(optarg, "zero") == 0) {
+				wl.arrival = ARR_ZERO;
+			} else if (strcmp(optarg, "uniform") == 0) {
+				wl.arrival = ARR_UNIFORM;
+			} else if (strcmp(optarg, "poisson") == 0) {
+				wl.arrival = ARR_POISSON;
+			} else if (strncmp(optarg, "burst", 5) == 0) {
+				wl.arrival = ARR_BURST;
+				if (optarg[5] == ':')
+					wl.burst = strtoul(optarg + 6, NULL, 10);
+				else if (optarg[5] != '\0')
+					return -1;
+			} else {
+				return -1;
+			}
+			break;
+		case 't':
+			span = strtol(optarg, NULL, 10);
+			break;
+		case 'l':
+			if (parse_range(optarg, &wl.len_min, &wl.len_max) < 0)
+				return -1;
+			break;
+		case 'z':
+			if (parse_range(optarg, &wl.size_min, &wl.size_max) < 0)
+				return -1;
+			break;
+		case 'r':
+			wl.nr_regs = strtoul(optarg, NULL, 10);
+			break;
+		case 'x':
+			if (parse_mix(optarg) < 0)
+				return -1;
+			break;
+		case 'P':
+			if (parse_prio(optarg) < 0)
+				return -1;
+			break;
+		default:
+			return -1;
+		}
+	}
+	if (optind != argc || wl.nr_procs == 0 || wl.nr_cpus == 0 ||
+			wl.time_slot == 0 || wl.burst == 0 || wl.size_min == 0 ||
+			wl.nr_regs == 0 || wl.nr_regs > PAGING_MAX_SYMTBL_SZ)
+		return -1;
+	if (wl.nr_progs == 0)
+		wl.nr_progs = wl.nr_procs < 100 ? wl.nr_procs : 100;
+	/* By default the arrivals keep the CPUs about busy */
+	wl.span = span >= 0 ? (unsigned long) span :
+		wl.nr_procs * (wl.len_min + wl.len_max) / 2 / wl.nr_cpus;
+	return 0;
+}
+
+int main(int argc, char * argv[]) {
+	char path[PATH_MAX], proc_dir[PATH_MAX];
+	unsigned long * start, i;
+	FILE * config;
+
+	if (parse_args(argc, argv) < 0) {
+		usage();
+		return 1;
+	}
+	rng_state = wl.seed * 0x9e3779b97f4a7c15ULL + 1;
+
+	/* Programs, named relative to input/proc/ unless written elsewhere */
+	snprintf(path, sizeof(path), "%s/proc", wl.dir);
+	mkdir(wl.dir, 0755);
+	mkdir(path, 0755);
+	if (strcmp(wl.dir, "input") == 0) {
+		proc_dir[0] = '\0';
+	} else if (realpath(path, proc_dir) == NULL) {
+		printf("Cannot open '%s'\n", path);
+		return 1;
+	} else {
+		strcat(proc_dir, "/");
+	}
+	for (i = 0; i < wl.nr_progs; i++) {
+		snprintf(path, sizeof(path), "%s/proc/%s_%lu", wl.dir, wl.name, i);
+		if (write_prog(path, pick_prio()) < 0) {
+			printf("Cannot write program at '%s'\n", path);
+			return 1;
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", wl.dir, wl.name);
+	if ((config = fopen(path, "w")) == NULL) {
+		printf("Cannot write config at '%s'\n", path);
+		return 1;
+	}
+	fprintf(config, "%lu %lu %lu", wl.time_slot, wl.nr_cpus, wl.nr_procs);
+	if (wl.policy != NULL)
+		fprintf(config, " %s", wl.policy);
+	fprintf(config, "\n%lu %lu 0 0 0\n", wl.ram, wl.swap);
+	start = arrivals();
+	for (i = 0; i < wl.nr_procs; i++) {
+		unsigned long prog = rng_range(0, wl.nr_progs - 1);
+
+		fprintf(config, "%lu %s%s_%lu %lu\n", start[i], proc_dir,
+			wl.name, prog, pick_prio());
+	}
+	free(start);
+	if (fclose(config) != 0) {
+		printf("Cannot write config at '%s'\n", path);
+		return 1;
+	}
+	return 0;
+}